@@ -0,0 +1,222 @@
+#pragma once
+
+// Allocation-tracking test mode.
+//
+// Build with RAILDOOR_TRACK_ALLOCATIONS defined (msbuild /p:RailDoorTrackAllocations=true) to
+// replace the global operator new/delete with counting versions. The app calls
+// ArmAllocationTracking() once its threads are running; every allocation after that point is a
+// steady-state allocation and makes the app exit with a failure code.
+//
+// All replaceable forms are covered, including the std::align_val_t overloads used for
+// over-aligned types. UntrackedAllocationScope exempts the calling thread for its lifetime; only
+// test harness code (DoorSim's event queue) uses it.
+//
+// The replacement operators are defined in this header, so include it from exactly one
+// translation unit per executable (main.cpp).
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef RAILDOOR_TRACK_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#endif
+
+namespace raildoor {
+
+struct AllocationStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t largest = 0;
+};
+
+#ifdef RAILDOOR_TRACK_ALLOCATIONS
+constexpr bool kAllocationTrackingEnabled = true;
+
+namespace detail {
+inline std::atomic<bool> g_alloc_armed{false};
+inline std::atomic<uint64_t> g_alloc_count{0};
+inline std::atomic<uint64_t> g_alloc_bytes{0};
+inline std::atomic<uint64_t> g_alloc_largest{0};
+inline thread_local int g_alloc_exempt_depth = 0;
+
+inline void CountAllocation(std::size_t size) {
+    if (g_alloc_armed.load(std::memory_order_relaxed) && g_alloc_exempt_depth == 0) {
+        g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+        g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+        uint64_t largest = g_alloc_largest.load(std::memory_order_relaxed);
+        while (size > largest &&
+               !g_alloc_largest.compare_exchange_weak(largest, size, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+inline void *TrackedAllocate(std::size_t size) {
+    CountAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+inline void *TrackedAllocateAligned(std::size_t size, std::align_val_t alignment) {
+    CountAllocation(size);
+    const std::size_t align = static_cast<std::size_t>(alignment);
+#ifdef _WIN32
+    return _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    void *ptr = nullptr;
+    return posix_memalign(&ptr, align < sizeof(void *) ? sizeof(void *) : align, size == 0 ? 1 : size) == 0 ? ptr
+                                                                                                          : nullptr;
+#endif
+}
+
+inline void FreeAligned(void *ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+}  // namespace detail
+
+inline void ArmAllocationTracking() {
+    detail::g_alloc_armed.store(true, std::memory_order_release);
+}
+
+class UntrackedAllocationScope {
+public:
+    UntrackedAllocationScope() {
+        ++detail::g_alloc_exempt_depth;
+    }
+    ~UntrackedAllocationScope() {
+        --detail::g_alloc_exempt_depth;
+    }
+    UntrackedAllocationScope(const UntrackedAllocationScope &) = delete;
+    UntrackedAllocationScope &operator=(const UntrackedAllocationScope &) = delete;
+};
+
+inline AllocationStats AllocationsSinceArmed() {
+    AllocationStats stats;
+    stats.count = detail::g_alloc_count.load(std::memory_order_relaxed);
+    stats.bytes = detail::g_alloc_bytes.load(std::memory_order_relaxed);
+    stats.largest = detail::g_alloc_largest.load(std::memory_order_relaxed);
+    return stats;
+}
+#else
+constexpr bool kAllocationTrackingEnabled = false;
+
+inline void ArmAllocationTracking() {}
+
+class UntrackedAllocationScope {
+public:
+    // User-provided so an unused scope does not warn.
+    UntrackedAllocationScope() {}
+    ~UntrackedAllocationScope() {}
+};
+
+inline AllocationStats AllocationsSinceArmed() {
+    return AllocationStats{};
+}
+#endif
+
+}  // namespace raildoor
+
+#ifdef RAILDOOR_TRACK_ALLOCATIONS
+void *operator new(std::size_t size) {
+    void *ptr = raildoor::detail::TrackedAllocate(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](std::size_t size) {
+    void *ptr = raildoor::detail::TrackedAllocate(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return raildoor::detail::TrackedAllocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return raildoor::detail::TrackedAllocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    std::free(ptr);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    void *ptr = raildoor::detail::TrackedAllocateAligned(size, alignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    void *ptr = raildoor::detail::TrackedAllocateAligned(size, alignment);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return raildoor::detail::TrackedAllocateAligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return raildoor::detail::TrackedAllocateAligned(size, alignment);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    raildoor::detail::FreeAligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    raildoor::detail::FreeAligned(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+    raildoor::detail::FreeAligned(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+    raildoor::detail::FreeAligned(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    raildoor::detail::FreeAligned(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    raildoor::detail::FreeAligned(ptr);
+}
+#endif
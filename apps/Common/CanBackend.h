@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "CANAPI_Types.h"
+
+#include "Logging.h"
+
+namespace raildoor {
+
+// Counters for comparing batched and one-frame-per-call I/O. A "call" is one driver call for
+// PeakCAN and one syscall (poll/recvmmsg/sendmmsg) for SocketCAN.
+struct CanBackendStats {
+    std::atomic<uint64_t> rx_calls{0};
+    std::atomic<uint64_t> rx_frames{0};
+    std::atomic<uint64_t> rx_dropped{0};
+    std::atomic<uint64_t> tx_calls{0};
+    std::atomic<uint64_t> tx_frames{0};
+};
+
+// Transport used by DoorNode and HmiApp. Methods mirror the CANAPI calls the apps made on
+// CPeakCAN, plus batch read/write so a backend can move several frames per call.
+// Read* is called from one rx thread; Write* may be called from any thread.
+class CanBackend {
+public:
+    virtual ~CanBackend() = default;
+
+    virtual const char *Name() const = 0;
+    virtual bool IsValidChannel(const std::string &channel) const = 0;
+    virtual CANAPI_Return_t ParseBitrate(const std::string &text, CANAPI_Bitrate_t &bitrate) const = 0;
+    // Nominal (arbitration) bit rate of a bitrate returned by ParseBitrate.
+    virtual CANAPI_Return_t BitsPerSecond(const CANAPI_Bitrate_t &bitrate, uint32_t &bits_per_second) const = 0;
+
+    virtual CANAPI_Return_t InitializeChannel(const std::string &channel) = 0;
+    virtual CANAPI_Return_t StartController(const CANAPI_Bitrate_t &bitrate) = 0;
+    virtual CANAPI_Return_t ResetController() = 0;
+    virtual CANAPI_Return_t TeardownChannel() = 0;
+
+    // Restricts reception to the given 11-bit data-frame IDs. Backends without an acceptance
+    // filter keep receiving everything, so callers must still check IDs.
+    virtual CANAPI_Return_t SetReceiveFilter(const uint32_t *ids, size_t count) {
+        (void)ids;
+        (void)count;
+        return CANERR_NOERROR;
+    }
+
+    // Waits up to timeout_ms for the first frame, then returns every frame already queued, up
+    // to capacity. count is 0 unless the result is CANERR_NOERROR.
+    virtual CANAPI_Return_t ReadMessages(CANAPI_Message_t *messages, size_t capacity, size_t &count,
+                                         uint16_t timeout_ms) = 0;
+    virtual CANAPI_Return_t WriteMessages(const CANAPI_Message_t *messages, size_t count, size_t &written) = 0;
+
+    // Controller status (bus-off, warning level, bus error). Flags that latch in the driver are
+    // cleared by the read. Called from the rx thread.
+    virtual CANAPI_Return_t GetStatus(CANAPI_Status_t &status) = 0;
+
+    // Receive time of a frame returned by ReadMessages, on the steady_clock timeline the apps use
+    // for staleness checks.
+    virtual std::chrono::steady_clock::time_point ReceiveTime(const CANAPI_Message_t &message) const = 0;
+
+    CANAPI_Return_t WriteMessage(const CANAPI_Message_t &message) {
+        size_t written = 0;
+        return WriteMessages(&message, 1, written);
+    }
+
+    const CanBackendStats &Stats() const {
+        return stats_;
+    }
+
+protected:
+    CanBackendStats stats_;
+};
+
+inline void LogCanStats(const char *prefix, const CanBackend &backend, std::chrono::nanoseconds rx_cpu) {
+    const CanBackendStats &stats = backend.Stats();
+    const uint64_t rx_calls = stats.rx_calls.load();
+    const uint64_t rx_frames = stats.rx_frames.load();
+    const uint64_t tx_calls = stats.tx_calls.load();
+    const uint64_t tx_frames = stats.tx_frames.load();
+    Log(prefix, "%s rx: %llu frames / %llu calls (%.2f frames/call), %.2f us rx CPU/frame, %llu dropped",
+        backend.Name(), static_cast<unsigned long long>(rx_frames), static_cast<unsigned long long>(rx_calls),
+        rx_calls ? static_cast<double>(rx_frames) / static_cast<double>(rx_calls) : 0.0,
+        rx_frames ? static_cast<double>(rx_cpu.count()) / 1000.0 / static_cast<double>(rx_frames) : 0.0,
+        static_cast<unsigned long long>(stats.rx_dropped.load()));
+    Log(prefix, "%s tx: %llu frames / %llu calls (%.2f frames/call)", backend.Name(),
+        static_cast<unsigned long long>(tx_frames), static_cast<unsigned long long>(tx_calls),
+        tx_calls ? static_cast<double>(tx_frames) / static_cast<double>(tx_calls) : 0.0);
+}
+
+}  // namespace raildoor
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "CANAPI_Types.h"
+
+#ifdef _WIN32
+#include "PeakCAN.h"
+#endif
+
+namespace raildoor {
+
+// Returns a static string; unknown codes map to "CAN error", so callers that need the
+// raw value should log rc alongside.
+inline const char *ErrorToString(CANAPI_Return_t rc) {
+    switch (rc) {
+        case CANERR_NOERROR:
+            return "OK";
+        case CANERR_BOFF:
+            return "bus-off";
+        case CANERR_EWRN:
+            return "error warning";
+        case CANERR_BERR:
+            return "bus error";
+        case CANERR_RX_EMPTY:
+            return "RX_EMPTY";
+        case CANERR_TIMEOUT:
+            return "TIMEOUT";
+        case CANERR_OFFLINE:
+            return "controller offline";
+        case CANERR_TX_BUSY:
+            return "TX_BUSY";
+        case CANERR_NOTINIT:
+            return "channel not initialized";
+        case CANERR_YETINIT:
+            return "channel already initialized";
+        case CANERR_HANDLE:
+            return "channel not found";
+        case CANERR_NOTSUPP:
+            return "not supported";
+#ifdef _WIN32
+        case CPeakCAN::DriverNotLoaded:
+            return "PCAN driver not loaded";
+        case CPeakCAN::HardwareAlreadyInUse:
+            return "PCAN hardware already in use";
+        case CPeakCAN::ClientAlreadyConnected:
+            return "PCAN client already connected";
+        case CPeakCAN::RegisterTestFailed:
+            return "PCAN hardware not found";
+#endif
+        default:
+            return "CAN error";
+    }
+}
+
+}  // namespace raildoor
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace raildoor {
+
+constexpr uint32_t kMaxStandardId = 0x7FFU;
+
+// CRC-15 of classic CAN (polynomial 0x4599) over a bit sequence, MSB first.
+inline uint16_t CanCrc15(const uint8_t *bits, size_t count) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const bool next = (bits[i] != 0) != (((crc >> 14) & 1U) != 0);
+        crc = static_cast<uint16_t>((crc << 1) & 0x7FFFU);
+        if (next) {
+            crc ^= 0x4599U;
+        }
+    }
+    return crc;
+}
+
+// Exact number of bit times a classic CAN frame occupies on the bus: the stuffed span from SOF to
+// the end of the CRC, plus CRC delimiter, ACK slot and delimiter, EOF and the 3-bit intermission.
+inline uint32_t ExactFrameBits(uint32_t id, bool extended, bool remote, uint8_t dlc, const uint8_t *data) {
+    uint8_t bits[160];
+    size_t count = 0;
+    auto push = [&](uint32_t value, int width) {
+        for (int i = width - 1; i >= 0; --i) {
+            bits[count++] = static_cast<uint8_t>((value >> i) & 1U);
+        }
+    };
+
+    const uint8_t dlc_field = static_cast<uint8_t>(dlc & 0x0FU);
+    const size_t data_bytes = remote ? 0U : std::min<size_t>(dlc_field, 8U);
+    push(0, 1);  // SOF
+    if (extended) {
+        push(id >> 18, 11);
+        push(1, 1);  // SRR
+        push(1, 1);  // IDE
+        push(id & 0x3FFFFU, 18);
+        push(remote ? 1U : 0U, 1);
+        push(0, 2);  // r1, r0
+    } else {
+        push(id & kMaxStandardId, 11);
+        push(remote ? 1U : 0U, 1);
+        push(0, 1);  // IDE
+        push(0, 1);  // r0
+    }
+    push(dlc_field, 4);
+    for (size_t i = 0; i < data_bytes; ++i) {
+        push(data[i], 8);
+    }
+    push(CanCrc15(bits, count), 15);
+
+    // A stuff bit follows every five identical bits and itself starts the next run.
+    uint32_t stuff_bits = 0;
+    uint8_t last = bits[0];
+    int run = 1;
+    for (size_t i = 1; i < count; ++i) {
+        if (bits[i] == last) {
+            if (++run == 5) {
+                ++stuff_bits;
+                last = static_cast<uint8_t>(!last);
+                run = 1;
+            }
+        } else {
+            last = bits[i];
+            run = 1;
+        }
+    }
+    return static_cast<uint32_t>(count) + stuff_bits + 13U;
+}
+
+// Worst-case bit times for a frame with the given payload, i.e. maximal stuffing
+// (Davis, Burns, Bril, Lukkien 2007): g + 8s + 13 + floor((g + 8s - 1) / 4).
+inline uint32_t WorstCaseFrameBits(bool extended, uint8_t data_bytes) {
+    const uint32_t g = extended ? 54U : 34U;
+    const uint32_t payload = 8U * std::min<uint32_t>(data_bytes, 8U);
+    return g + payload + 13U + (g + payload - 1U) / 4U;
+}
+
+}  // namespace raildoor
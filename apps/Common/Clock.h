@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "AllocationTracker.h"
+
+namespace raildoor {
+
+// Time source and sleep for the app loops. Both apps run on SystemClock; DoorSim drives the same
+// logic from SimScheduler so scenarios run on virtual time.
+class Clock {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+    using duration = std::chrono::steady_clock::duration;
+
+    virtual ~Clock() = default;
+    virtual time_point Now() = 0;
+    virtual void SleepUntil(time_point deadline) = 0;
+
+    void SleepFor(duration interval) {
+        SleepUntil(Now() + interval);
+    }
+};
+
+class SystemClock final : public Clock {
+public:
+    time_point Now() override {
+        return std::chrono::steady_clock::now();
+    }
+
+    void SleepUntil(time_point deadline) override {
+        std::this_thread::sleep_until(deadline);
+    }
+};
+
+// Discrete-event scheduler on a virtual clock. Events run in time order (FIFO for equal times),
+// single-threaded, and Now() jumps straight to the next event, so a scenario costs only the work
+// its events do. With pacing enabled each event waits for its wall-clock time instead, which
+// replays the same event sequence in real time.
+//
+// SleepUntil runs every event due up to the deadline; call it from the driver, not from inside
+// an event.
+//
+// The queue is test harness, not app code: At() builds the event's std::function inside an
+// UntrackedAllocationScope, so an allocation-tracked DoorSim counts only what the apps' logic
+// allocates.
+class SimScheduler final : public Clock {
+public:
+    using Action = std::function<void()>;
+
+    explicit SimScheduler(bool paced = false) : paced_(paced) {}
+
+    time_point Now() override {
+        return now_;
+    }
+
+    void SleepUntil(time_point deadline) override {
+        RunUntil(deadline);
+    }
+
+    template <typename F>
+    void At(time_point when, F &&action) {
+        UntrackedAllocationScope untracked;
+        if (when < now_) {
+            when = now_;
+        }
+        queue_.push_back(Event{when, next_sequence_++, Action(std::forward<F>(action))});
+        std::push_heap(queue_.begin(), queue_.end(), Later());
+    }
+
+    template <typename F>
+    void After(duration delay, F &&action) {
+        At(now_ + delay, std::forward<F>(action));
+    }
+
+    // Runs events due at or before deadline, then advances the clock to it. Returns false if
+    // Stop() was called.
+    bool RunUntil(time_point deadline) {
+        const auto wall_start = std::chrono::steady_clock::now();
+        const time_point virtual_start = now_;
+        while (!stopped_ && !queue_.empty() && queue_.front().when <= deadline) {
+            std::pop_heap(queue_.begin(), queue_.end(), Later());
+            Event event = std::move(queue_.back());
+            queue_.pop_back();
+            if (paced_) {
+                std::this_thread::sleep_until(wall_start + (event.when - virtual_start));
+            }
+            now_ = event.when;
+            ++executed_;
+            event.action();
+        }
+        if (!stopped_ && deadline > now_) {
+            if (paced_) {
+                std::this_thread::sleep_until(wall_start + (deadline - virtual_start));
+            }
+            now_ = deadline;
+        }
+        return !stopped_;
+    }
+
+    void Stop() {
+        stopped_ = true;
+    }
+
+    bool Stopped() const {
+        return stopped_;
+    }
+
+    uint64_t ExecutedEvents() const {
+        return executed_;
+    }
+
+private:
+    struct Event {
+        time_point when;
+        uint64_t sequence;
+        Action action;
+    };
+
+    struct Later {
+        bool operator()(const Event &a, const Event &b) const {
+            return a.when != b.when ? a.when > b.when : a.sequence > b.sequence;
+        }
+    };
+
+    bool paced_;
+    bool stopped_ = false;
+    // Virtual time starts at an arbitrary non-zero epoch so "never updated" (zero) stays distinct.
+    time_point now_ = time_point(std::chrono::hours(1));
+    uint64_t next_sequence_ = 0;
+    uint64_t executed_ = 0;
+    // Binary heap ordered by Later, so the earliest event is at the front.
+    std::vector<Event> queue_;
+};
+
+}  // namespace raildoor
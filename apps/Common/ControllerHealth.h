@@ -0,0 +1,427 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "CANAPI_Types.h"
+
+#include "CanBackend.h"
+#include "CanErrors.h"
+#include "DurationHistogram.h"
+#include "Logging.h"
+
+namespace raildoor {
+
+// CAN fault confinement as the apps see it. CANAPI reports error-warning and error-passive
+// through the same warning_level flag, so both map to ErrorPassive.
+enum class ControllerState : uint8_t {
+    Active,
+    ErrorPassive,
+    BusOff
+};
+
+inline const char *ControllerStateToString(ControllerState state) {
+    switch (state) {
+        case ControllerState::Active:
+            return "ACTIVE";
+        case ControllerState::ErrorPassive:
+            return "PASSIVE";
+        case ControllerState::BusOff:
+            return "BUS-OFF";
+    }
+    return "UNKNOWN";
+}
+
+struct ControllerHealthSettings {
+    // Status poll period when no error frame or error code asked for one sooner.
+    std::chrono::milliseconds status_period{100};
+    // Error-passive (or inside an error storm) with no frame in or out for this long counts as
+    // deaf, and the controller is restarted as if it were bus-off.
+    std::chrono::milliseconds deaf_timeout{1000};
+    // Error frames within one second that make an error storm.
+    uint32_t storm_errors_per_s = 100;
+    // Restart backoff: the first restart of an episode is immediate, then initial, 2x, 4x, ...
+    // up to max. The backoff resets after stable_period without a fault.
+    std::chrono::milliseconds backoff_initial{100};
+    std::chrono::milliseconds backoff_max{5000};
+    std::chrono::milliseconds stable_period{10000};
+};
+
+struct ControllerHealthSummary {
+    ControllerState state = ControllerState::Active;
+    uint64_t error_frames = 0;
+    uint64_t storms = 0;
+    uint64_t bus_off_events = 0;
+    uint64_t passive_events = 0;
+    uint64_t restarts = 0;
+    uint64_t restart_failures = 0;
+    uint64_t driver_restarts = 0;   // bus-off recoveries the driver made on its own
+    uint64_t skipped_restarts = 0;  // deaf episodes the backend could not restart
+    DurationStats recovery;  // fault detected -> controller restarted (by the app or the driver)
+    DurationStats outage;    // fault detected -> first good frame in or out
+};
+
+// Tracks controller health from error frames, read/write result codes and status polls, and
+// decides when to restart the controller. Times are passed in, so the same code runs under the
+// apps' rx threads and under DoorSim's virtual clock. Not thread-safe: the apps hold a health
+// mutex around every call, since their tx paths report write results from another thread.
+//
+// The owner's loop, per wake-up:
+//   - OnErrorFrame for each status frame (sts != 0), OnTraffic for each data frame;
+//   - OnResult for read/write codes other than OK/RX_EMPTY/TIMEOUT, OnWriteAccepted for good writes;
+//   - ServiceControllerHealth, which polls the status and restarts when due.
+class ControllerHealth {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    explicit ControllerHealth(const char *log_prefix, const ControllerHealthSettings &settings = {})
+        : log_prefix_(log_prefix), settings_(settings) {}
+
+    ControllerState State() const {
+        return state_;
+    }
+
+    bool InStorm() const {
+        return storm_;
+    }
+
+    // Status frames are backend-specific, so their content is left to GetStatus; a frame only
+    // counts towards storm detection and brings the next status poll forward.
+    void OnErrorFrame(time_point now) {
+        ++error_frames_;
+        poll_due_ = true;
+        CountError(now);
+    }
+
+    void OnResult(CANAPI_Return_t rc, time_point now) {
+        switch (rc) {
+            case CANERR_BOFF:
+                EnterFault(ControllerState::BusOff, now);
+                break;
+            case CANERR_EWRN:
+                if (state_ == ControllerState::Active) {
+                    EnterFault(ControllerState::ErrorPassive, now);
+                }
+                break;
+            case CANERR_BERR:
+                CountError(now);
+                poll_due_ = true;
+                break;
+            case CANERR_OFFLINE:
+                // SocketCAN reports a bus-off interface as ENETDOWN; the status tells which.
+                poll_due_ = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // A data frame was received.
+    void OnTraffic(time_point now) {
+        Heard(now);
+    }
+
+    // A write was accepted into the transmit queue. That only proves the bus works once a status
+    // poll after it shows no error, so the frame counts as traffic from that poll on.
+    void OnWriteAccepted(time_point now) {
+        if (!write_unconfirmed_) {
+            write_unconfirmed_ = true;
+            write_time_ = now;
+        }
+    }
+
+    bool StatusPollDue(time_point now) const {
+        return poll_due_ || now - last_poll_ >= settings_.status_period;
+    }
+
+    void OnStatus(const CANAPI_Status_t &status, time_point now) {
+        last_poll_ = now;
+        poll_due_ = false;
+        if (write_unconfirmed_) {
+            write_unconfirmed_ = false;
+            if (!status.bus_off && !status.bus_error) {
+                Heard(write_time_);
+            }
+        }
+        if (status.bus_off) {
+            EnterFault(ControllerState::BusOff, now);
+        } else if (status.warning_level) {
+            if (state_ == ControllerState::Active) {
+                EnterFault(ControllerState::ErrorPassive, now);
+            }
+        } else if (state_ == ControllerState::ErrorPassive) {
+            // Bus-off is only left through a restart; error-passive clears on its own.
+            state_ = ControllerState::Active;
+            Log(log_prefix_, "CAN controller back to error-active");
+        }
+        if (status.bus_error) {
+            CountError(now);
+        }
+        if (storm_ && now - window_start_ >= kStormWindow + kStormWindow) {
+            EndStorm();
+        }
+    }
+
+    bool RecoveryDue(time_point now) const {
+        if (now < next_attempt_) {
+            return false;
+        }
+        if (state_ == ControllerState::BusOff) {
+            return true;
+        }
+        const bool degraded = state_ == ControllerState::ErrorPassive || storm_;
+        return degraded && !deaf_skipped_ && now - last_traffic_ >= settings_.deaf_timeout;
+    }
+
+    // Result of the ResetController/StartController pair the owner ran because RecoveryDue.
+    void OnRecoveryAttempt(CANAPI_Return_t rc, time_point now) {
+        last_attempt_ = now;
+        ++restarts_in_row_;
+        if (rc != CANERR_NOERROR) {
+            ++restart_failures_;
+            next_attempt_ = now + Backoff();
+            LogRateLimited(log_prefix_, restart_limiter_, std::chrono::milliseconds(1000),
+                           "CAN controller restart failed: %s (rc=%d), retrying in %lld ms", ErrorToString(rc), rc,
+                           static_cast<long long>(Backoff().count()));
+            return;
+        }
+        ++restarts_;
+        if (!in_outage_) {
+            // A deaf restart inside a storm; the outage runs from the storm's detection.
+            in_outage_ = true;
+            outage_start_ = detected_;
+        }
+        const uint32_t ms = ToMs(now - detected_);
+        recovery_.Add(ms);
+        Log(log_prefix_, "CAN controller restarted %u ms after %s (restart %u in a row)", ms,
+            ControllerStateToString(state_), restarts_in_row_);
+        state_ = ControllerState::Active;
+        // Frames queued before the restart were discarded with it; the deaf timer starts over.
+        write_unconfirmed_ = false;
+        last_traffic_ = now;
+    }
+
+    // The owner's backend cannot restart the controller (ResetController returned CANERR_NOTSUPP).
+    // For bus-off, rc is StartController's report of whether the driver has restarted it on its
+    // own; that recovery is real and counted as a driver restart. A deaf controller stays as it
+    // is: the episode is counted once as skipped and nothing is recorded as a restart.
+    void OnRestartUnsupported(CANAPI_Return_t rc, time_point now) {
+        if (state_ != ControllerState::BusOff) {
+            deaf_skipped_ = true;
+            ++skipped_restarts_;
+            LogRateLimited(log_prefix_, restart_limiter_, std::chrono::milliseconds(1000),
+                           "CAN controller deaf for %u ms while %s; the backend cannot restart it",
+                           ToMs(now - last_traffic_), storm_ ? "in an error storm" : ControllerStateToString(state_));
+            return;
+        }
+        if (rc != CANERR_NOERROR) {
+            // Checked again on the next status poll; no backoff, since nothing is being restarted.
+            next_attempt_ = now + settings_.status_period;
+            LogRateLimited(log_prefix_, restart_limiter_, std::chrono::milliseconds(1000),
+                           "CAN controller still bus-off (%s), waiting for the driver to restart it", ErrorToString(rc));
+            return;
+        }
+        ++driver_restarts_;
+        const uint32_t ms = ToMs(now - detected_);
+        recovery_.Add(ms);
+        Log(log_prefix_, "CAN controller restarted by the driver %u ms after BUS-OFF", ms);
+        state_ = ControllerState::Active;
+        write_unconfirmed_ = false;
+        last_traffic_ = now;
+    }
+
+    ControllerHealthSummary Summarize() const {
+        ControllerHealthSummary summary;
+        summary.state = state_;
+        summary.error_frames = error_frames_;
+        summary.storms = storms_;
+        summary.bus_off_events = bus_off_events_;
+        summary.passive_events = passive_events_;
+        summary.restarts = restarts_;
+        summary.restart_failures = restart_failures_;
+        summary.driver_restarts = driver_restarts_;
+        summary.skipped_restarts = skipped_restarts_;
+        summary.recovery = SummarizeDurations(recovery_);
+        summary.outage = SummarizeDurations(outage_);
+        return summary;
+    }
+
+private:
+    static constexpr auto kStormWindow = std::chrono::seconds(1);
+
+    static uint32_t ToMs(std::chrono::steady_clock::duration duration) {
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+    }
+
+    void Heard(time_point when) {
+        if (when > last_traffic_) {
+            last_traffic_ = when;
+            deaf_skipped_ = false;
+        }
+        // An error-passive controller still takes part in bus traffic; only bus-off is deaf.
+        if (state_ == ControllerState::BusOff) {
+            return;
+        }
+        if (in_outage_ && when >= outage_start_) {
+            in_outage_ = false;
+            const uint32_t ms = ToMs(when - outage_start_);
+            outage_.Add(ms);
+            Log(log_prefix_, "CAN traffic resumed after %u ms outage", ms);
+        }
+        if (state_ == ControllerState::Active && restarts_in_row_ > 0 &&
+            when - last_attempt_ >= settings_.stable_period) {
+            restarts_in_row_ = 0;
+        }
+    }
+
+    std::chrono::milliseconds Backoff() const {
+        std::chrono::milliseconds delay = settings_.backoff_initial;
+        for (uint32_t i = 1; i < restarts_in_row_ && delay < settings_.backoff_max; ++i) {
+            delay += delay;
+        }
+        return delay < settings_.backoff_max ? delay : settings_.backoff_max;
+    }
+
+    void EnterFault(ControllerState state, time_point now) {
+        if (state == state_) {
+            return;
+        }
+        if (state == ControllerState::BusOff) {
+            ++bus_off_events_;
+            LogRateLimited(log_prefix_, bus_off_limiter_, std::chrono::milliseconds(1000), "CAN controller bus-off");
+        } else {
+            ++passive_events_;
+            LogRateLimited(log_prefix_, passive_limiter_, std::chrono::milliseconds(1000),
+                           "CAN controller error-passive");
+        }
+        if (state_ == ControllerState::Active) {
+            detected_ = now;
+            // Back-to-back faults wait out the backoff; the first one in a while restarts at once.
+            const time_point earliest = restarts_in_row_ == 0 ? now : last_attempt_ + Backoff();
+            next_attempt_ = earliest > now ? earliest : now;
+        }
+        if (!in_outage_) {
+            in_outage_ = true;
+            outage_start_ = now;
+        }
+        state_ = state;
+    }
+
+    void CountError(time_point now) {
+        if (now - window_start_ >= kStormWindow) {
+            if (storm_ && window_errors_ < settings_.storm_errors_per_s) {
+                EndStorm();
+            }
+            window_start_ = now;
+            window_errors_ = 0;
+        }
+        if (++window_errors_ < settings_.storm_errors_per_s || storm_) {
+            return;
+        }
+        storm_ = true;
+        ++storms_;
+        LogRateLimited(log_prefix_, storm_limiter_, std::chrono::milliseconds(1000),
+                       "CAN error storm: %u error frames within %lld ms", window_errors_,
+                       static_cast<long long>(
+                           std::chrono::duration_cast<std::chrono::milliseconds>(now - window_start_).count()));
+        if (state_ == ControllerState::Active) {
+            detected_ = now;
+        }
+    }
+
+    void EndStorm() {
+        storm_ = false;
+        Log(log_prefix_, "CAN error storm over");
+    }
+
+    const char *log_prefix_;
+    ControllerHealthSettings settings_;
+    ControllerState state_ = ControllerState::Active;
+    bool poll_due_ = true;
+    time_point last_poll_{};
+    time_point last_traffic_{};
+    time_point detected_{};
+    time_point outage_start_{};
+    bool in_outage_ = false;
+    bool write_unconfirmed_ = false;
+    time_point write_time_{};
+    time_point last_attempt_{};
+    time_point next_attempt_{};
+    uint32_t restarts_in_row_ = 0;
+    bool deaf_skipped_ = false;
+    bool storm_ = false;
+    time_point window_start_{};
+    uint32_t window_errors_ = 0;
+    uint64_t error_frames_ = 0;
+    uint64_t storms_ = 0;
+    uint64_t bus_off_events_ = 0;
+    uint64_t passive_events_ = 0;
+    uint64_t restarts_ = 0;
+    uint64_t restart_failures_ = 0;
+    uint64_t driver_restarts_ = 0;
+    uint64_t skipped_restarts_ = 0;
+    RateLimiter bus_off_limiter_;
+    RateLimiter storm_limiter_;
+    RateLimiter passive_limiter_;
+    RateLimiter restart_limiter_;
+    DurationHistogram recovery_;
+    DurationHistogram outage_;
+};
+
+// One health step for an rx loop: polls the controller status when due and, when the engine asks
+// for it, restarts the controller and re-applies the receive filter. A backend that cannot restart
+// its controller only gets asked whether the driver has. The caller holds its health mutex.
+//
+// The restart runs under control_mutex, which every thread writing to the same backend also holds
+// around WriteMessage(s), so no frame is sent into a controller that is half reset. Null when the
+// caller is the backend's only user (DoorSim).
+inline void ServiceControllerHealth(CanBackend &can, std::mutex *control_mutex, ControllerHealth &health,
+                                    const CANAPI_Bitrate_t &bitrate, const uint32_t *rx_ids, size_t rx_id_count,
+                                    std::chrono::steady_clock::time_point now) {
+    if (health.StatusPollDue(now)) {
+        CANAPI_Status_t status{};
+        if (can.GetStatus(status) == CANERR_NOERROR) {
+            health.OnStatus(status, now);
+        }
+    }
+    if (!health.RecoveryDue(now)) {
+        return;
+    }
+    std::unique_lock<std::mutex> control_lock;
+    if (control_mutex != nullptr) {
+        control_lock = std::unique_lock<std::mutex>(*control_mutex);
+    }
+    if (can.ResetController() == CANERR_NOTSUPP) {
+        health.OnRestartUnsupported(
+            health.State() == ControllerState::BusOff ? can.StartController(bitrate) : CANERR_NOTSUPP, now);
+        return;
+    }
+    CANAPI_Return_t rc = can.StartController(bitrate);
+    if (rc == CANERR_NOERROR) {
+        rc = can.SetReceiveFilter(rx_ids, rx_id_count);
+    }
+    health.OnRecoveryAttempt(rc, now);
+}
+
+inline void LogControllerHealth(const char *prefix, const ControllerHealth &health) {
+    const ControllerHealthSummary summary = health.Summarize();
+    Log(prefix, "CAN health: %s, %llu error frames, %llu storms, %llu bus-off, %llu passive, %llu restarts "
+                "(%llu failed), %llu driver restarts, %llu deaf restarts skipped",
+        ControllerStateToString(summary.state), static_cast<unsigned long long>(summary.error_frames),
+        static_cast<unsigned long long>(summary.storms), static_cast<unsigned long long>(summary.bus_off_events),
+        static_cast<unsigned long long>(summary.passive_events), static_cast<unsigned long long>(summary.restarts),
+        static_cast<unsigned long long>(summary.restart_failures),
+        static_cast<unsigned long long>(summary.driver_restarts),
+        static_cast<unsigned long long>(summary.skipped_restarts));
+    const DurationStats *stats[] = {&summary.recovery, &summary.outage};
+    const char *labels[] = {"recovery", "outage"};
+    for (size_t i = 0; i < 2; ++i) {
+        Log(prefix, "CAN %s n=%llu mean=%u p50=%u p95=%u p99=%u max=%u ms", labels[i],
+            static_cast<unsigned long long>(stats[i]->count), stats[i]->mean_ms, stats[i]->p50_ms, stats[i]->p95_ms,
+            stats[i]->p99_ms, stats[i]->max_ms);
+    }
+}
+
+}  // namespace raildoor
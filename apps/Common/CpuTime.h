@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace raildoor {
+
+// CPU time consumed so far by the calling thread (user + kernel).
+inline std::chrono::nanoseconds ThreadCpuTime() {
+#ifdef _WIN32
+    FILETIME creation{};
+    FILETIME exit{};
+    FILETIME kernel{};
+    FILETIME user{};
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return std::chrono::nanoseconds(0);
+    }
+    auto to_ticks = [](const FILETIME &ft) {
+        return (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    };
+    // FILETIME ticks are 100 ns.
+    return std::chrono::nanoseconds(static_cast<long long>((to_ticks(kernel) + to_ticks(user)) * 100ULL));
+#else
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+#endif
+}
+
+}  // namespace raildoor
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "CANAPI_Types.h"
+
+namespace raildoor {
+
+// Frame IDs and payload layout are defined in docs/ICD.md.
+constexpr uint32_t kCommandId = 0x201U;
+constexpr uint32_t kStatusIdBase = 0x101U;
+constexpr uint32_t kStatusIdMax = 0x103U;
+constexpr size_t kDoorCount = 3;
+
+// Command codes carried in byte 1 of kCommandId.
+constexpr uint8_t kCommandOpen = 1;
+constexpr uint8_t kCommandClose = 2;
+constexpr uint8_t kCommandResetFault = 3;
+
+enum class DoorState : uint8_t {
+    Closed = 0,
+    Open = 1,
+    Moving = 2,
+    Faulted = 3
+};
+
+// True for the states the ICD defines; other values arrive only from a faulty or newer node.
+inline bool IsKnownDoorState(uint8_t raw) {
+    return raw <= static_cast<uint8_t>(DoorState::Faulted);
+}
+
+inline const char *DoorStateToString(DoorState state) {
+    switch (state) {
+        case DoorState::Closed:
+            return "CLOSED";
+        case DoorState::Open:
+            return "OPEN";
+        case DoorState::Moving:
+            return "MOVING";
+        case DoorState::Faulted:
+            return "FAULTED";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+struct DoorStatus {
+    DoorState state = DoorState::Closed;
+    uint8_t fault_code = 0;
+    uint8_t obstruction = 0;
+};
+
+inline CANAPI_Message_t BuildStatusMessage(int door_id, const DoorStatus &status) {
+    CANAPI_Message_t message{};
+    message.id = kStatusIdBase + static_cast<uint32_t>(door_id - 1);
+    message.xtd = 0;
+    message.rtr = 0;
+    message.sts = 0;
+    message.dlc = 8;
+    message.data[0] = static_cast<uint8_t>(status.state);
+    message.data[1] = status.obstruction;
+    message.data[2] = status.fault_code;
+    message.data[3] = static_cast<uint8_t>(door_id);
+    for (int i = 4; i < 8; ++i) {
+        message.data[i] = 0;
+    }
+    return message;
+}
+
+inline CANAPI_Message_t BuildCommandMessage(uint8_t door_id, uint8_t cmd) {
+    CANAPI_Message_t message{};
+    message.id = kCommandId;
+    message.xtd = 0;
+    message.rtr = 0;
+    message.sts = 0;
+    message.dlc = 8;
+    message.data[0] = door_id;
+    message.data[1] = cmd;
+    for (int i = 2; i < 8; ++i) {
+        message.data[i] = 0;
+    }
+    return message;
+}
+
+}  // namespace raildoor
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace raildoor {
+
+// Log-linear histogram of durations in milliseconds. Values below 8 ms are exact; above that each
+// power of two is split into 8 sub-buckets, so a percentile is within 12.5% of the true value and
+// a query walks a fixed 240 buckets regardless of how many samples were added.
+class DurationHistogram {
+public:
+    static constexpr uint32_t kSubBucketBits = 3;
+    static constexpr uint32_t kSubBuckets = 1U << kSubBucketBits;
+    static constexpr size_t kBuckets = (32 - kSubBucketBits + 1) * kSubBuckets;
+
+    void Add(uint32_t ms) {
+        ++counts_[BucketOf(ms)];
+        ++count_;
+        sum_ms_ += ms;
+        if (ms > max_ms_) {
+            max_ms_ = ms;
+        }
+    }
+
+    uint64_t Count() const {
+        return count_;
+    }
+
+    uint32_t MeanMs() const {
+        return count_ == 0 ? 0U : static_cast<uint32_t>(sum_ms_ / count_);
+    }
+
+    uint32_t MaxMs() const {
+        return max_ms_;
+    }
+
+    // Upper bound of the bucket holding the given percentile (0..100), capped at the maximum.
+    uint32_t PercentileMs(uint32_t percentile) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = (count_ * percentile + 99) / 100;
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint32_t upper = BucketUpperMs(i);
+                return upper < max_ms_ ? upper : max_ms_;
+            }
+        }
+        return max_ms_;
+    }
+
+private:
+    static uint32_t MostSignificantBit(uint32_t value) {
+        uint32_t msb = 0;
+        while ((value >> (msb + 1)) != 0) {
+            ++msb;
+        }
+        return msb;
+    }
+
+    static size_t BucketOf(uint32_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        uint32_t msb = MostSignificantBit(value);
+        uint32_t sub = (value >> (msb - kSubBucketBits)) & (kSubBuckets - 1);
+        return ((msb - kSubBucketBits + 1) << kSubBucketBits) + sub;
+    }
+
+    static uint32_t BucketUpperMs(size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return static_cast<uint32_t>(bucket);
+        }
+        uint32_t group = static_cast<uint32_t>(bucket >> kSubBucketBits);
+        uint32_t sub = static_cast<uint32_t>(bucket & (kSubBuckets - 1));
+        uint64_t lower = static_cast<uint64_t>(kSubBuckets + sub) << (group - 1);
+        uint64_t upper = lower + (1ULL << (group - 1)) - 1;
+        return upper > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(upper);
+    }
+
+    std::array<uint32_t, kBuckets> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ms_ = 0;
+    uint32_t max_ms_ = 0;
+};
+
+struct DurationStats {
+    uint64_t count = 0;
+    uint32_t mean_ms = 0;
+    uint32_t p50_ms = 0;
+    uint32_t p95_ms = 0;
+    uint32_t p99_ms = 0;
+    uint32_t max_ms = 0;
+};
+
+inline DurationStats SummarizeDurations(const DurationHistogram &histogram) {
+    DurationStats stats;
+    stats.count = histogram.Count();
+    stats.mean_ms = histogram.MeanMs();
+    stats.p50_ms = histogram.PercentileMs(50);
+    stats.p95_ms = histogram.PercentileMs(95);
+    stats.p99_ms = histogram.PercentileMs(99);
+    stats.max_ms = histogram.MaxMs();
+    return stats;
+}
+
+}  // namespace raildoor
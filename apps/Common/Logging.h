@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+
+#if defined(__GNUC__)
+#define RAILDOOR_PRINTF_LIKE(fmt_index, args_index) __attribute__((format(printf, fmt_index, args_index)))
+#else
+#define RAILDOOR_PRINTF_LIKE(fmt_index, args_index)
+#endif
+
+namespace raildoor {
+
+// Log lines are formatted into fixed stack buffers so the rx/tx/display loops never allocate.
+// Anything longer than kLogLineCapacity is truncated.
+constexpr size_t kLogLineCapacity = 256;
+constexpr size_t kTimestampCapacity = 16;
+
+// Silences Log() (not LogError) process-wide. DoorSim sets it so long scenarios are not dominated
+// by printing every door transition.
+inline std::atomic<bool> g_log_muted{false};
+
+inline void FormatTimestamp(char (&buffer)[kTimestampCapacity]) {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+    std::tm tm_snapshot{};
+#ifdef _WIN32
+    localtime_s(&tm_snapshot, &time);
+#else
+    localtime_r(&time, &tm_snapshot);
+#endif
+    size_t length = std::strftime(buffer, sizeof(buffer), "%H:%M:%S", &tm_snapshot);
+    std::snprintf(buffer + length, sizeof(buffer) - length, ".%03d", static_cast<int>(ms.count()));
+}
+
+inline void VLogLine(std::FILE *stream, const char *prefix, const char *tag, const char *format, va_list args) {
+    char timestamp[kTimestampCapacity];
+    FormatTimestamp(timestamp);
+    char message[kLogLineCapacity];
+    std::vsnprintf(message, sizeof(message), format, args);
+    // One fprintf per line: the stream lock keeps lines from different threads intact.
+    std::fprintf(stream, "[%s] %s %s%s\n", timestamp, prefix, tag, message);
+    std::fflush(stream);
+}
+
+inline void Log(const char *prefix, const char *format, ...) RAILDOOR_PRINTF_LIKE(2, 3);
+inline void Log(const char *prefix, const char *format, ...) {
+    if (g_log_muted.load(std::memory_order_relaxed)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    VLogLine(stdout, prefix, "", format, args);
+    va_end(args);
+}
+
+inline void LogError(const char *prefix, const char *format, ...) RAILDOOR_PRINTF_LIKE(2, 3);
+inline void LogError(const char *prefix, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    VLogLine(stderr, prefix, "ERROR: ", format, args);
+    va_end(args);
+}
+
+struct RateLimiter {
+    std::chrono::steady_clock::time_point last_log{};
+    size_t suppressed = 0;
+};
+
+inline void LogRateLimited(const char *prefix,
+                           RateLimiter &limiter,
+                           std::chrono::milliseconds interval,
+                           const char *format,
+                           ...) RAILDOOR_PRINTF_LIKE(4, 5);
+inline void LogRateLimited(const char *prefix,
+                           RateLimiter &limiter,
+                           std::chrono::milliseconds interval,
+                           const char *format,
+                           ...) {
+    auto now = std::chrono::steady_clock::now();
+    if (limiter.last_log.time_since_epoch().count() != 0 && now - limiter.last_log < interval) {
+        ++limiter.suppressed;
+        return;
+    }
+
+    char message[kLogLineCapacity];
+    va_list args;
+    va_start(args, format);
+    int length = std::vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (limiter.suppressed > 0 && length >= 0 && static_cast<size_t>(length) < sizeof(message)) {
+        std::snprintf(message + length, sizeof(message) - static_cast<size_t>(length),
+                      " (%zu similar errors suppressed)", limiter.suppressed);
+    }
+    limiter.suppressed = 0;
+    Log(prefix, "%s", message);
+    limiter.last_log = now;
+}
+
+}  // namespace raildoor
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "PeakCAN.h"
+#include "PCANBasic.h"
+
+#include "CanBackend.h"
+
+namespace raildoor {
+
+// CanBackend over the PCANBasic-Wrapper (Windows). The wrapper reads one frame per call, so
+// ReadMessages drains the receive queue with zero-timeout reads after the first frame arrives.
+class PeakCanBackend final : public CanBackend {
+public:
+    ~PeakCanBackend() override {
+        if (initialized_) {
+            can_api_.TeardownChannel();
+        }
+    }
+
+    const char *Name() const override {
+        return "PCAN";
+    }
+
+    bool IsValidChannel(const std::string &channel) const override {
+        uint32_t handle = 0;
+        return TryParseChannel(channel, handle);
+    }
+
+    CANAPI_Return_t ParseBitrate(const std::string &text, CANAPI_Bitrate_t &bitrate) const override {
+        bool data = false;
+        bool sam = false;
+        return CPeakCAN::MapString2Bitrate(text.c_str(), bitrate, data, sam);
+    }
+
+    CANAPI_Return_t BitsPerSecond(const CANAPI_Bitrate_t &bitrate, uint32_t &bits_per_second) const override {
+        CANAPI_BusSpeed_t speed{};
+        CANAPI_Return_t rc = CPeakCAN::MapBitrate2Speed(bitrate, speed);
+        if (rc != CANERR_NOERROR) {
+            return rc;
+        }
+        bits_per_second = static_cast<uint32_t>(speed.nominal.speed + 0.5f);
+        return bits_per_second > 0 ? CANERR_NOERROR : CANERR_BAUDRATE;
+    }
+
+    CANAPI_Return_t InitializeChannel(const std::string &channel) override {
+        uint32_t handle = 0;
+        if (!TryParseChannel(channel, handle)) {
+            return CANERR_ILLPARA;
+        }
+        // Error frames come through as status messages (sts=1) for the controller health engine.
+        CANAPI_OpMode_t op_mode{};
+        op_mode.byte = static_cast<uint8_t>(CANMODE_DEFAULT | CANMODE_NXTD | CANMODE_ERR);
+        CANAPI_Return_t rc = can_api_.InitializeChannel(static_cast<int32_t>(handle), op_mode);
+        initialized_ = (rc == CANERR_NOERROR);
+        return rc;
+    }
+
+    CANAPI_Return_t StartController(const CANAPI_Bitrate_t &bitrate) override {
+        return can_api_.StartController(bitrate);
+    }
+
+    CANAPI_Return_t ResetController() override {
+        return can_api_.ResetController();
+    }
+
+    CANAPI_Return_t TeardownChannel() override {
+        initialized_ = false;
+        return can_api_.TeardownChannel();
+    }
+
+    CANAPI_Return_t ReadMessages(CANAPI_Message_t *messages, size_t capacity, size_t &count,
+                                 uint16_t timeout_ms) override {
+        count = 0;
+        CANAPI_Return_t rc = CANERR_NOERROR;
+        while (count < capacity) {
+            rc = can_api_.ReadMessage(messages[count], count == 0 ? timeout_ms : 0U);
+            stats_.rx_calls.fetch_add(1, std::memory_order_relaxed);
+            if (rc != CANERR_NOERROR) {
+                break;
+            }
+            ++count;
+        }
+        stats_.rx_frames.fetch_add(count, std::memory_order_relaxed);
+        if (count > 0) {
+            return CANERR_NOERROR;
+        }
+        return rc;
+    }
+
+    CANAPI_Return_t WriteMessages(const CANAPI_Message_t *messages, size_t count, size_t &written) override {
+        written = 0;
+        while (written < count) {
+            CANAPI_Return_t rc = can_api_.WriteMessage(messages[written], 0U);
+            stats_.tx_calls.fetch_add(1, std::memory_order_relaxed);
+            if (rc != CANERR_NOERROR) {
+                return rc;
+            }
+            ++written;
+            stats_.tx_frames.fetch_add(1, std::memory_order_relaxed);
+        }
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t GetStatus(CANAPI_Status_t &status) override {
+        return can_api_.GetStatus(status);
+    }
+
+    // The wrapper's timestamps are driver-relative, so the read time stands in for the
+    // receive time, as it always has on this backend.
+    std::chrono::steady_clock::time_point ReceiveTime(const CANAPI_Message_t &message) const override {
+        (void)message;
+        return std::chrono::steady_clock::now();
+    }
+
+private:
+    static bool TryParseChannel(const std::string &text, uint32_t &channel) {
+        if (text.rfind("PCAN_USBBUS", 0) == 0) {
+            std::string suffix = text.substr(std::string("PCAN_USBBUS").size());
+            int index = std::atoi(suffix.c_str());
+            static const uint32_t kUsbMap[] = {
+                PCAN_USBBUS1,  PCAN_USBBUS2,  PCAN_USBBUS3,  PCAN_USBBUS4,
+                PCAN_USBBUS5,  PCAN_USBBUS6,  PCAN_USBBUS7,  PCAN_USBBUS8,
+                PCAN_USBBUS9,  PCAN_USBBUS10, PCAN_USBBUS11, PCAN_USBBUS12,
+                PCAN_USBBUS13, PCAN_USBBUS14, PCAN_USBBUS15, PCAN_USBBUS16};
+            if (index >= 1 && index <= 16) {
+                channel = kUsbMap[index - 1];
+                return true;
+            }
+        }
+
+        if (!text.empty() && (std::isdigit(static_cast<unsigned char>(text[0])) || text.rfind("0x", 0) == 0)) {
+            try {
+                channel = static_cast<uint32_t>(std::stoul(text, nullptr, 0));
+                return true;
+            } catch (...) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    CPeakCAN can_api_;
+    bool initialized_ = false;
+};
+
+}  // namespace raildoor
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+
+#include "CanBackend.h"
+
+#ifdef _WIN32
+#include "PeakCanBackend.h"
+#elif defined(__linux__)
+#include "SocketCanBackend.h"
+#else
+#error "No CAN backend for this platform"
+#endif
+
+namespace raildoor {
+
+#ifdef _WIN32
+constexpr const char *kDefaultChannel = "PCAN_USBBUS1";
+#else
+constexpr const char *kDefaultChannel = "can0";
+#endif
+
+inline std::unique_ptr<CanBackend> CreatePlatformCanBackend() {
+#ifdef _WIN32
+    return std::make_unique<PeakCanBackend>();
+#else
+    return std::make_unique<SocketCanBackend>();
+#endif
+}
+
+}  // namespace raildoor
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "DoorProtocol.h"
+
+namespace raildoor {
+
+// Door table that HmiApp publishes for other local processes (dashboards, recorders, a GUI).
+// Include this header to read it: SharedDoorTableReader attaches to the segment, Read() takes a
+// consistent snapshot of one door without a syscall (and gives up only if the writer died
+// mid-update), and WaitForChange() blocks on a futex
+// (a named semaphore on Windows) until HmiApp publishes again.
+//
+// Layout, version 1. Every block starts on its own 64-byte cache line:
+//   line 0   header: magic, version, door count, record size, writer PID (0 once HmiApp exits)
+//   line 1   change counter (the futex word) and waiting-reader count
+//   line 2+  one record per door, each guarded by its own seqlock
+// Timestamps are steady_clock nanoseconds, which share one epoch across processes on a machine.
+
+constexpr uint32_t kSharedDoorTableMagic = 0x42544452U;  // "RDTB"
+constexpr uint16_t kSharedDoorTableVersion = 1;
+constexpr size_t kCacheLineBytes = 64;
+constexpr const char *kDefaultSharedDoorTableName = "raildoor_doortable";
+
+struct alignas(kCacheLineBytes) SharedDoorTableHeader {
+    std::atomic<uint32_t> magic;  // stored last, once the rest of the header is valid
+    uint16_t version;
+    uint16_t door_count;
+    uint32_t record_bytes;
+    uint32_t total_bytes;
+    std::atomic<uint64_t> writer_pid;
+};
+
+struct alignas(kCacheLineBytes) SharedDoorTableSignal {
+    std::atomic<uint32_t> change_count;
+    std::atomic<uint32_t> waiters;
+};
+
+// Payload fields are atomics accessed relaxed; the sequence orders them. Odd while a write is in
+// progress.
+struct alignas(kCacheLineBytes) SharedDoorRecord {
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> status;  // state | obstruction << 8 | fault_code << 16
+    std::atomic<int64_t> last_update_ns;
+    std::atomic<int64_t> published_ns;
+    std::atomic<uint64_t> updates;
+};
+
+struct SharedDoorTableLayout {
+    SharedDoorTableHeader header;
+    SharedDoorTableSignal signal;
+    SharedDoorRecord doors[kDoorCount];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<int64_t>::is_always_lock_free,
+              "shared-memory atomics must be lock-free");
+static_assert(std::is_standard_layout<SharedDoorTableLayout>::value, "layout is shared with other processes");
+static_assert(sizeof(SharedDoorRecord) == kCacheLineBytes, "one door per cache line");
+static_assert(sizeof(SharedDoorTableLayout) == (2 + kDoorCount) * kCacheLineBytes, "layout version 1 size");
+
+struct SharedDoorSnapshot {
+    DoorState state = DoorState::Closed;
+    uint8_t obstruction = 0;
+    uint8_t fault_code = 0;
+    std::chrono::steady_clock::time_point last_update{};  // HMI receive time of the last status frame
+    std::chrono::steady_clock::time_point published{};    // when HmiApp wrote this record
+    uint64_t updates = 0;                                 // 0 until the door's first status frame
+};
+
+enum class SharedTableStatus : uint8_t {
+    Ok = 0,
+    NotFound = 1,
+    Incompatible = 2,
+    SystemError = 3,
+    InUse = 4
+};
+
+inline const char *SharedTableStatusToString(SharedTableStatus status) {
+    switch (status) {
+        case SharedTableStatus::Ok:
+            return "OK";
+        case SharedTableStatus::NotFound:
+            return "segment not found (is HmiApp running?)";
+        case SharedTableStatus::Incompatible:
+            return "incompatible layout version";
+        case SharedTableStatus::SystemError:
+            return "system error";
+        case SharedTableStatus::InUse:
+            return "already published by another running process";
+        default:
+            return "unknown";
+    }
+}
+
+namespace detail {
+
+inline int64_t SteadyNs(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+inline std::chrono::steady_clock::time_point FromSteadyNs(int64_t ns) {
+    return std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+// The mapping plus the wake-up primitive. Linux: POSIX shm object "/<name>" and a shared futex on
+// the change counter. Windows: "Local\<name>" file mapping and the "Local\<name>.changed" semaphore.
+class SharedDoorTableMapping {
+public:
+    SharedDoorTableMapping() = default;
+    SharedDoorTableMapping(const SharedDoorTableMapping &) = delete;
+    SharedDoorTableMapping &operator=(const SharedDoorTableMapping &) = delete;
+
+    ~SharedDoorTableMapping() {
+        Unmap();
+    }
+
+    SharedTableStatus Map(const std::string &name, bool create) {
+        Unmap();
+        const size_t size = sizeof(SharedDoorTableLayout);
+#ifdef _WIN32
+        const std::string mapping_name = "Local\\" + name;
+        const std::string semaphore_name = mapping_name + ".changed";
+        if (create) {
+            mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                          static_cast<DWORD>(size), mapping_name.c_str());
+            semaphore_ = CreateSemaphoreA(nullptr, 0, LONG_MAX, semaphore_name.c_str());
+        } else {
+            mapping_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mapping_name.c_str());
+            semaphore_ = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, FALSE, semaphore_name.c_str());
+        }
+        if (mapping_ == nullptr || semaphore_ == nullptr) {
+            const DWORD error = GetLastError();
+            Unmap();
+            return error == ERROR_FILE_NOT_FOUND ? SharedTableStatus::NotFound : SharedTableStatus::SystemError;
+        }
+        void *view = MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+        const std::string shm_name = "/" + name;
+        const int fd = ::shm_open(shm_name.c_str(), create ? (O_CREAT | O_RDWR) : O_RDWR, 0660);
+        if (fd < 0) {
+            return errno == ENOENT ? SharedTableStatus::NotFound : SharedTableStatus::SystemError;
+        }
+        struct stat info {};
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            return SharedTableStatus::SystemError;
+        }
+        if (static_cast<size_t>(info.st_size) < size) {
+            if (!create) {
+                ::close(fd);
+                return SharedTableStatus::Incompatible;
+            }
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                ::close(fd);
+                return SharedTableStatus::SystemError;
+            }
+        }
+        void *view = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED) {
+            view = nullptr;
+        }
+#endif
+        if (view == nullptr) {
+            Unmap();
+            return SharedTableStatus::SystemError;
+        }
+        layout_ = static_cast<SharedDoorTableLayout *>(view);
+        return SharedTableStatus::Ok;
+    }
+
+    void Unmap() {
+#ifdef _WIN32
+        if (layout_ != nullptr) {
+            UnmapViewOfFile(layout_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+            mapping_ = nullptr;
+        }
+        if (semaphore_ != nullptr) {
+            CloseHandle(semaphore_);
+            semaphore_ = nullptr;
+        }
+#else
+        if (layout_ != nullptr) {
+            ::munmap(layout_, sizeof(SharedDoorTableLayout));
+        }
+#endif
+        layout_ = nullptr;
+    }
+
+    SharedDoorTableLayout *Layout() const {
+        return layout_;
+    }
+
+    // Blocks while the change counter still equals expected, up to timeout.
+    void Wait(uint32_t expected, std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+        (void)expected;
+        WaitForSingleObject(semaphore_, static_cast<DWORD>(timeout.count()));
+#else
+        timespec relative{};
+        relative.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+        relative.tv_nsec = static_cast<long>((timeout.count() % 1000) * 1000000L);
+        // Not FUTEX_PRIVATE_FLAG: the word lives in memory shared between processes.
+        ::syscall(SYS_futex, &layout_->signal.change_count, FUTEX_WAIT, expected, &relative, nullptr, 0);
+#endif
+    }
+
+    void Wake(uint32_t waiters) {
+#ifdef _WIN32
+        // A waiter that timed out meanwhile leaves a spare count; it only causes an early return.
+        ReleaseSemaphore(semaphore_, static_cast<LONG>(waiters), nullptr);
+#else
+        (void)waiters;
+        ::syscall(SYS_futex, &layout_->signal.change_count, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+private:
+    SharedDoorTableLayout *layout_ = nullptr;
+#ifdef _WIN32
+    HANDLE mapping_ = nullptr;
+    HANDLE semaphore_ = nullptr;
+#endif
+};
+
+inline uint32_t PackDoorStatus(DoorState state, uint8_t obstruction, uint8_t fault_code) {
+    return static_cast<uint32_t>(state) | (static_cast<uint32_t>(obstruction) << 8) |
+           (static_cast<uint32_t>(fault_code) << 16);
+}
+
+inline int CurrentProcessId() {
+#ifdef _WIN32
+    return static_cast<int>(GetCurrentProcessId());
+#else
+    return static_cast<int>(::getpid());
+#endif
+}
+
+// False once the process has exited. A PID reused by another process reads as alive.
+inline bool ProcessAlive(uint64_t pid) {
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+    if (process == nullptr) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    const bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+}  // namespace detail
+
+// HmiApp side. One writer per segment; Publish and Notify are called from the rx thread and
+// never allocate or enter the kernel, except Notify when a reader is blocked in WaitForChange.
+class SharedDoorTableWriter {
+public:
+    // Creates the segment, or takes over one left by a writer that has exited. Returns InUse, and
+    // changes nothing, while the recorded writer is still running: a second writer would break the
+    // seqlock.
+    SharedTableStatus Create(const std::string &name) {
+        SharedTableStatus status = mapping_.Map(name, true);
+        if (status != SharedTableStatus::Ok) {
+            return status;
+        }
+        SharedDoorTableLayout *layout = mapping_.Layout();
+        SharedDoorTableHeader &header = layout->header;
+        const bool reusable = header.magic.load(std::memory_order_acquire) == kSharedDoorTableMagic &&
+                              header.version == kSharedDoorTableVersion && header.door_count == kDoorCount;
+        if (!reusable) {
+            // Readers still attached to a left-over segment keep their seqlock state only if the
+            // layout matches; anything else starts from zero.
+            std::memset(static_cast<void *>(layout), 0, sizeof(SharedDoorTableLayout));
+            header.version = kSharedDoorTableVersion;
+            header.door_count = static_cast<uint16_t>(kDoorCount);
+            header.record_bytes = static_cast<uint32_t>(sizeof(SharedDoorRecord));
+            header.total_bytes = static_cast<uint32_t>(sizeof(SharedDoorTableLayout));
+            header.magic.store(kSharedDoorTableMagic, std::memory_order_release);
+        } else {
+            uint64_t previous = header.writer_pid.load(std::memory_order_acquire);
+            if ((previous != 0 && detail::ProcessAlive(previous)) ||
+                !header.writer_pid.compare_exchange_strong(
+                    previous, static_cast<uint64_t>(detail::CurrentProcessId()), std::memory_order_acq_rel)) {
+                // Running, or another process starting at the same moment claimed it first.
+                mapping_.Unmap();
+                return SharedTableStatus::InUse;
+            }
+            // A writer that crashed inside Publish left its record's sequence odd, and readers killed
+            // inside WaitForChange left their waiter entries behind. Round each sequence up to the next
+            // even value (the record stays valid; a torn payload is overwritten by the next Publish) and
+            // start the waiter count over. A reader still blocked from before simply times out.
+            for (SharedDoorRecord &record : layout->doors) {
+                const uint32_t sequence = record.sequence.load(std::memory_order_relaxed);
+                if ((sequence & 1U) != 0) {
+                    record.sequence.store(sequence + 1U, std::memory_order_release);
+                }
+            }
+            layout->signal.waiters.store(0, std::memory_order_seq_cst);
+        }
+        header.writer_pid.store(static_cast<uint64_t>(detail::CurrentProcessId()), std::memory_order_release);
+        return SharedTableStatus::Ok;
+    }
+
+    bool IsOpen() const {
+        return mapping_.Layout() != nullptr;
+    }
+
+    // Writes one door record. Readers see it after the next Notify() or by polling Read().
+    void Publish(size_t door_index, DoorState state, uint8_t obstruction, uint8_t fault_code,
+                 std::chrono::steady_clock::time_point last_update) {
+        SharedDoorRecord &record = mapping_.Layout()->doors[door_index];
+        const uint32_t sequence = record.sequence.load(std::memory_order_relaxed);
+        record.sequence.store(sequence + 1U, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.status.store(detail::PackDoorStatus(state, obstruction, fault_code), std::memory_order_relaxed);
+        record.last_update_ns.store(detail::SteadyNs(last_update), std::memory_order_relaxed);
+        record.published_ns.store(detail::SteadyNs(std::chrono::steady_clock::now()), std::memory_order_relaxed);
+        record.updates.store(record.updates.load(std::memory_order_relaxed) + 1U, std::memory_order_relaxed);
+        record.sequence.store(sequence + 2U, std::memory_order_release);
+    }
+
+    // Signals one round of Publish calls. Call once per rx batch rather than per frame.
+    void Notify() {
+        SharedDoorTableSignal &signal = mapping_.Layout()->signal;
+        // seq_cst on both sides: either the reader sees the new count or we see its waiter entry.
+        signal.change_count.fetch_add(1U, std::memory_order_seq_cst);
+        const uint32_t waiters = signal.waiters.load(std::memory_order_seq_cst);
+        if (waiters != 0) {
+            mapping_.Wake(waiters);
+        }
+    }
+
+    // Marks the writer gone and wakes readers so they can notice.
+    void Close() {
+        if (!IsOpen()) {
+            return;
+        }
+        mapping_.Layout()->header.writer_pid.store(0, std::memory_order_release);
+        Notify();
+        mapping_.Unmap();
+    }
+
+    ~SharedDoorTableWriter() {
+        Close();
+    }
+
+private:
+    detail::SharedDoorTableMapping mapping_;
+};
+
+// Reader side; any number of readers in any number of processes. One instance may be shared by
+// several threads as long as each keeps its own last_seen for WaitForChange.
+class SharedDoorTableReader {
+public:
+    SharedTableStatus Open(const std::string &name = kDefaultSharedDoorTableName) {
+        SharedTableStatus status = mapping_.Map(name, false);
+        if (status != SharedTableStatus::Ok) {
+            return status;
+        }
+        const SharedDoorTableHeader &header = mapping_.Layout()->header;
+        if (header.magic.load(std::memory_order_acquire) != kSharedDoorTableMagic ||
+            header.version != kSharedDoorTableVersion || header.door_count != kDoorCount ||
+            header.record_bytes != sizeof(SharedDoorRecord)) {
+            mapping_.Unmap();
+            return SharedTableStatus::Incompatible;
+        }
+        return SharedTableStatus::Ok;
+    }
+
+    bool IsOpen() const {
+        return mapping_.Layout() != nullptr;
+    }
+
+    // PID of the publishing HmiApp, or 0 after it shut down.
+    uint64_t WriterPid() const {
+        return mapping_.Layout()->header.writer_pid.load(std::memory_order_acquire);
+    }
+
+    // True while a writer is attached and its process still exists.
+    bool WriterAlive() const {
+        const uint64_t pid = WriterPid();
+        return pid != 0 && detail::ProcessAlive(pid);
+    }
+
+    // Consistent snapshot of one door. Retries while the writer is mid-update, which a live writer
+    // never is for more than a few stores. Returns false, leaving snapshot untouched, if the record
+    // stays mid-update because the writer died inside Publish; the next writer's Create repairs it.
+    bool Read(size_t door_index, SharedDoorSnapshot &snapshot) const {
+        const SharedDoorRecord &record = mapping_.Layout()->doors[door_index];
+        for (unsigned spins = 0;; ++spins) {
+            const uint32_t before = record.sequence.load(std::memory_order_acquire);
+            if ((before & 1U) == 0) {
+                const uint32_t status = record.status.load(std::memory_order_relaxed);
+                const int64_t last_update_ns = record.last_update_ns.load(std::memory_order_relaxed);
+                const int64_t published_ns = record.published_ns.load(std::memory_order_relaxed);
+                const uint64_t updates = record.updates.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (record.sequence.load(std::memory_order_relaxed) == before) {
+                    snapshot.state = static_cast<DoorState>(status & 0xFFU);
+                    snapshot.obstruction = static_cast<uint8_t>((status >> 8) & 0xFFU);
+                    snapshot.fault_code = static_cast<uint8_t>((status >> 16) & 0xFFU);
+                    snapshot.last_update = detail::FromSteadyNs(last_update_ns);
+                    snapshot.published = detail::FromSteadyNs(published_ns);
+                    snapshot.updates = updates;
+                    return true;
+                }
+            }
+            if (spins >= 64) {
+                // The writer was preempted inside its critical section; let it finish, unless it is gone.
+                if (spins % 1024 == 0 && !WriterAlive()) {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Change counter, bumped by every Notify(). Polling readers compare it to skip Read() calls.
+    uint32_t ChangeCount() const {
+        return mapping_.Layout()->signal.change_count.load(std::memory_order_acquire);
+    }
+
+    // Returns true as soon as the change counter differs from last_seen, updating last_seen;
+    // false on timeout. Only blocks (in the kernel) when nothing has changed.
+    bool WaitForChange(uint32_t &last_seen, std::chrono::milliseconds timeout) {
+        SharedDoorTableSignal &signal = mapping_.Layout()->signal;
+        uint32_t current = signal.change_count.load(std::memory_order_acquire);
+        if (current == last_seen) {
+            signal.waiters.fetch_add(1U, std::memory_order_seq_cst);
+            current = signal.change_count.load(std::memory_order_seq_cst);
+            if (current == last_seen) {
+                mapping_.Wait(last_seen, timeout);
+                current = signal.change_count.load(std::memory_order_acquire);
+            }
+            // Never below zero: a restarted writer may have reset the count while we waited.
+            uint32_t waiters = signal.waiters.load(std::memory_order_seq_cst);
+            while (waiters != 0 &&
+                   !signal.waiters.compare_exchange_weak(waiters, waiters - 1U, std::memory_order_seq_cst)) {
+            }
+        }
+        if (current == last_seen) {
+            return false;
+        }
+        last_seen = current;
+        return true;
+    }
+
+    void Close() {
+        mapping_.Unmap();
+    }
+
+private:
+    detail::SharedDoorTableMapping mapping_;
+};
+
+}  // namespace raildoor
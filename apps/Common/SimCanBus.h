@@ -0,0 +1,600 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CANAPI_Types.h"
+
+#include "CanBackend.h"
+#include "CanFrameTiming.h"
+#include "Clock.h"
+
+namespace raildoor {
+
+class SimCanBackend;
+
+// In-process stand-in for a CAN line on SimScheduler's virtual clock. Frames queued by the
+// attached backends contend by ID when the bus is idle, occupy it for their exact stuffed length,
+// and reach every other started backend at end of frame, so bus load and queuing delay behave like
+// the real line. There is no loopback.
+//
+// StartErrorStorm injects bus errors for fault-injection runs. An error destroys the frame on the
+// bus (or the next one to start, if the bus is idle), signals an error frame to every node and
+// retransmits the frame, with the ISO 11898-1 counter rules: the sender's TEC +8, each receiver's
+// REC +1, and -1 for every good frame. A node is error-warning from 96, and bus-off when TEC
+// passes 255.
+//
+// StartCut models a cut between the HMI and the doors on a redundant line: frames still go through,
+// acknowledged by a node on the sender's side, so no node sees an error, but no frame reaches a
+// receiver until the cut ends.
+//
+// SetDeliveryLatency models the receive path of a redundant line (repeater, gateway, USB adapter):
+// frames reach the other nodes a fixed delay plus a random jitter after end of frame, in order.
+class SimCanBus {
+public:
+    SimCanBus(SimScheduler &scheduler, uint32_t bits_per_second)
+        : scheduler_(scheduler), bits_per_second_(bits_per_second) {}
+
+    SimCanBus(const SimCanBus &) = delete;
+    SimCanBus &operator=(const SimCanBus &) = delete;
+
+    uint32_t BitsPerSecond() const {
+        return bits_per_second_;
+    }
+
+    void Attach(SimCanBackend *node) {
+        nodes_.push_back(node);
+    }
+
+    void Send(SimCanBackend *sender, const CANAPI_Message_t &message) {
+        Queue(Pending{message, sender, next_sequence_++});
+        if (!busy_) {
+            StartNext();
+        }
+    }
+
+    uint64_t FramesTransmitted() const {
+        return frames_;
+    }
+
+    uint64_t FramesDestroyed() const {
+        return errors_;
+    }
+
+    // Injects errors_per_second evenly spaced bus errors for the next length of virtual time,
+    // replacing any storm still running.
+    void StartErrorStorm(std::chrono::nanoseconds length, double errors_per_second) {
+        const bool ticking = scheduler_.Now() < storm_end_;
+        storm_end_ = scheduler_.Now() + length;
+        storm_interval_ = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / errors_per_second));
+        if (!ticking) {
+            StormTick();
+        }
+    }
+
+    // Delivers no frame for the next length of virtual time, replacing any cut still in effect.
+    void StartCut(std::chrono::nanoseconds length) {
+        cut_end_ = scheduler_.Now() + length;
+    }
+
+    uint64_t FramesLost() const {
+        return lost_;
+    }
+
+    // Delays every delivery by delay plus a uniform 0..jitter drawn from a generator seeded with
+    // seed, so runs stay reproducible. Zero for both (the default) delivers at end of frame.
+    void SetDeliveryLatency(std::chrono::nanoseconds delay, std::chrono::nanoseconds jitter, uint64_t seed) {
+        delivery_delay_ = delay;
+        delivery_jitter_ = jitter;
+        random_state_ = seed;
+    }
+
+    // Drops the sender's queued frames, as a controller reset or bus-off does.
+    void Abort(SimCanBackend *sender);
+
+    std::chrono::nanoseconds BusyTime() const {
+        return busy_time_;
+    }
+
+private:
+    struct Pending {
+        CANAPI_Message_t message;
+        SimCanBackend *sender;
+        uint64_t sequence;
+    };
+
+    // Error flag, worst-case echo, delimiter and intermission.
+    static constexpr uint32_t kErrorFrameBits = 6 + 6 + 8 + 3;
+
+    // The simulated wire is test harness, like SimScheduler's queue: its growth during an error
+    // storm is not an allocation of the apps' logic.
+    void Queue(const Pending &pending) {
+        UntrackedAllocationScope untracked;
+        pending_.push_back(pending);
+    }
+
+    void StartNext();
+    void Complete(uint64_t generation);
+    void DeliverToReceivers(const CANAPI_Message_t &message, const SimCanBackend *sender);
+    uint64_t NextRandom();
+    void StormTick();
+    void DestroyInFlight();
+
+    SimScheduler &scheduler_;
+    uint32_t bits_per_second_;
+    std::vector<SimCanBackend *> nodes_;
+    std::vector<Pending> pending_;
+    Pending in_flight_{};
+    // A frame is on the bus (busy_ also covers error frames).
+    bool transmitting_ = false;
+    std::chrono::steady_clock::time_point in_flight_end_{};
+    // Bumped when a frame is destroyed, so its pending Complete is ignored.
+    uint64_t generation_ = 0;
+    uint64_t next_sequence_ = 0;
+    bool busy_ = false;
+    uint64_t frames_ = 0;
+    uint64_t errors_ = 0;
+    std::chrono::nanoseconds busy_time_{0};
+    std::chrono::steady_clock::time_point storm_end_{};
+    std::chrono::nanoseconds storm_interval_{0};
+    bool error_armed_ = false;
+    std::chrono::steady_clock::time_point cut_end_{};
+    uint64_t lost_ = 0;
+    std::chrono::nanoseconds delivery_delay_{0};
+    std::chrono::nanoseconds delivery_jitter_{0};
+    uint64_t random_state_ = 0;
+    std::chrono::steady_clock::time_point last_delivery_{};
+};
+
+// CanBackend on a SimCanBus. Channel names are "sim<N>". Nothing blocks on virtual time: ReadMessages
+// ignores its timeout and returns CANERR_RX_EMPTY when the queue is empty, and the receive
+// handler tells the simulation driver when to read.
+//
+// Error frames bypass the receive filter and arrive as status messages (sts=1, dlc=3): data[0]
+// is the CANAPI status byte, data[1] TEC (capped at 255) and data[2] REC. A restart after bus-off
+// resets the counters but keeps the node off the bus for the 128 x 11 recessive bits of the
+// bus-off recovery sequence; writes in that window return CANERR_TX_BUSY.
+class SimCanBackend final : public CanBackend {
+public:
+    static constexpr size_t kRxQueueCapacity = 256;
+    static constexpr size_t kMaxFilters = 16;
+
+    SimCanBackend(SimCanBus &bus, SimScheduler &scheduler) : bus_(bus), scheduler_(scheduler) {
+        bus_.Attach(this);
+    }
+
+    const char *Name() const override {
+        return "SimCAN";
+    }
+
+    bool IsValidChannel(const std::string &channel) const override {
+        return channel.size() > 3 && channel.compare(0, 3, "sim") == 0;
+    }
+
+    CANAPI_Return_t ParseBitrate(const std::string &text, CANAPI_Bitrate_t &bitrate) const override {
+        uint32_t bits_per_second = 0;
+        return LookupBitrate(text, bitrate, bits_per_second) ? CANERR_NOERROR : CANERR_BAUDRATE;
+    }
+
+    CANAPI_Return_t BitsPerSecond(const CANAPI_Bitrate_t &bitrate, uint32_t &bits_per_second) const override {
+        for (const BitrateEntry &entry : kBitrates) {
+            if (bitrate.index == entry.index) {
+                bits_per_second = static_cast<uint32_t>(entry.bits_per_second);
+                return CANERR_NOERROR;
+            }
+        }
+        return CANERR_BAUDRATE;
+    }
+
+    // ParseBitrate without a backend, for sizing the SimCanBus before any node exists.
+    static bool LookupBitrate(const std::string &text, CANAPI_Bitrate_t &bitrate, uint32_t &bits_per_second) {
+        for (const BitrateEntry &entry : kBitrates) {
+            if (text == entry.text || std::strtoul(text.c_str(), nullptr, 10) == entry.bits_per_second) {
+                bitrate = CANAPI_Bitrate_t{};
+                bitrate.index = entry.index;
+                bits_per_second = static_cast<uint32_t>(entry.bits_per_second);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    CANAPI_Return_t InitializeChannel(const std::string &channel) override {
+        if (!IsValidChannel(channel)) {
+            return CANERR_ILLPARA;
+        }
+        if (initialized_) {
+            return CANERR_YETINIT;
+        }
+        initialized_ = true;
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t StartController(const CANAPI_Bitrate_t &bitrate) override {
+        if (!initialized_) {
+            return CANERR_NOTINIT;
+        }
+        uint32_t bits_per_second = 0;
+        if (BitsPerSecond(bitrate, bits_per_second) != CANERR_NOERROR || bits_per_second != bus_.BitsPerSecond()) {
+            return CANERR_BAUDRATE;
+        }
+        if (bus_off_) {
+            const int64_t recovery_bits = 128 * 11;
+            online_at_ = scheduler_.Now() + std::chrono::nanoseconds(recovery_bits * 1000000000LL / bits_per_second);
+            bus_off_ = false;
+        }
+        tec_ = 0;
+        rec_ = 0;
+        started_ = true;
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t ResetController() override {
+        started_ = false;
+        rx_head_ = 0;
+        rx_count_ = 0;
+        bus_.Abort(this);
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t TeardownChannel() override {
+        ResetController();
+        initialized_ = false;
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t SetReceiveFilter(const uint32_t *ids, size_t count) override {
+        if (count > kMaxFilters) {
+            return CANERR_ILLPARA;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            filters_[i] = ids[i];
+        }
+        filter_count_ = count;
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t ReadMessages(CANAPI_Message_t *messages, size_t capacity, size_t &count,
+                                 uint16_t timeout_ms) override {
+        (void)timeout_ms;
+        count = 0;
+        if (!started_) {
+            return CANERR_OFFLINE;
+        }
+        stats_.rx_calls.fetch_add(1, std::memory_order_relaxed);
+        while (count < capacity && rx_count_ > 0) {
+            messages[count++] = rx_queue_[rx_head_];
+            rx_head_ = (rx_head_ + 1) % kRxQueueCapacity;
+            --rx_count_;
+        }
+        if (count == 0) {
+            return CANERR_RX_EMPTY;
+        }
+        stats_.rx_frames.fetch_add(count, std::memory_order_relaxed);
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t WriteMessages(const CANAPI_Message_t *messages, size_t count, size_t &written) override {
+        written = 0;
+        if (!started_) {
+            return CANERR_OFFLINE;
+        }
+        if (bus_off_) {
+            return CANERR_BOFF;
+        }
+        if (!Online()) {
+            return CANERR_TX_BUSY;
+        }
+        stats_.tx_calls.fetch_add(1, std::memory_order_relaxed);
+        for (; written < count; ++written) {
+            bus_.Send(this, messages[written]);
+        }
+        stats_.tx_frames.fetch_add(written, std::memory_order_relaxed);
+        return CANERR_NOERROR;
+    }
+
+    std::chrono::steady_clock::time_point ReceiveTime(const CANAPI_Message_t &message) const override {
+        const int64_t ns = static_cast<int64_t>(message.timestamp.tv_sec) * 1000000000LL +
+                           static_cast<int64_t>(message.timestamp.tv_nsec);
+        return std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+    }
+
+    CANAPI_Return_t GetStatus(CANAPI_Status_t &status) override {
+        if (!initialized_) {
+            return CANERR_NOTINIT;
+        }
+        status = Status();
+        bus_error_ = false;
+        return CANERR_NOERROR;
+    }
+
+    uint32_t TransmitErrorCount() const {
+        return tec_;
+    }
+
+    uint32_t ReceiveErrorCount() const {
+        return rec_;
+    }
+
+    // Called after frames were queued, at their virtual arrival time.
+    void SetReceiveHandler(std::function<void()> handler) {
+        receive_handler_ = std::move(handler);
+    }
+
+    // Bus side: a frame finished transmission at the current virtual time.
+    void Deliver(const CANAPI_Message_t &message) {
+        if (!OnBus()) {
+            return;
+        }
+        if (rec_ > 127) {
+            rec_ = 127;
+        } else if (rec_ > 0) {
+            --rec_;
+        }
+        if (Accepts(message) && Enqueue(message)) {
+            NotifyReceived();
+        }
+    }
+
+    // Bus side: this node's frame went through.
+    void OnTransmitted() {
+        if (tec_ > 0) {
+            --tec_;
+        }
+    }
+
+    // Bus side: an error frame destroyed the frame on the bus. Queues the error frame without
+    // calling the receive handler, so the bus can finish its bookkeeping first.
+    void OnBusError(bool sender) {
+        if (!OnBus()) {
+            return;
+        }
+        bus_error_ = true;
+        if (sender) {
+            tec_ += 8;
+            bus_off_ = tec_ > 255;
+        } else if (rec_ < 255) {
+            ++rec_;
+        }
+        CANAPI_Message_t error{};
+        error.sts = 1;
+        error.dlc = 3;
+        error.data[0] = Status().byte;
+        error.data[1] = static_cast<uint8_t>(tec_ > 255 ? 255 : tec_);
+        error.data[2] = static_cast<uint8_t>(rec_);
+        Enqueue(error);
+    }
+
+    bool BusOff() const {
+        return bus_off_;
+    }
+
+    void NotifyReceived() {
+        if (rx_count_ > 0 && receive_handler_) {
+            receive_handler_();
+        }
+    }
+
+private:
+    struct BitrateEntry {
+        const char *text;
+        int32_t index;
+        unsigned long bits_per_second;
+    };
+
+    static constexpr BitrateEntry kBitrates[] = {
+        {"1M", CANBTR_INDEX_1M, 1000000UL},     {"800k", CANBTR_INDEX_800K, 800000UL},
+        {"500k", CANBTR_INDEX_500K, 500000UL},  {"250k", CANBTR_INDEX_250K, 250000UL},
+        {"125k", CANBTR_INDEX_125K, 125000UL},  {"100k", CANBTR_INDEX_100K, 100000UL},
+        {"50k", CANBTR_INDEX_50K, 50000UL},     {"20k", CANBTR_INDEX_20K, 20000UL},
+        {"10k", CANBTR_INDEX_10K, 10000UL},
+    };
+
+    bool Online() const {
+        return scheduler_.Now() >= online_at_;
+    }
+
+    bool OnBus() const {
+        return started_ && !bus_off_ && Online();
+    }
+
+    CANAPI_Status_t Status() const {
+        CANAPI_Status_t status{};
+        status.can_stopped = started_ ? 0 : 1;
+        status.bus_off = bus_off_ ? 1 : 0;
+        status.warning_level = (tec_ >= 96 || rec_ >= 96) ? 1 : 0;
+        status.bus_error = bus_error_ ? 1 : 0;
+        status.receiver_empty = rx_count_ == 0 ? 1 : 0;
+        return status;
+    }
+
+    bool Enqueue(const CANAPI_Message_t &message) {
+        if (rx_count_ == kRxQueueCapacity) {
+            stats_.rx_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        CANAPI_Message_t &slot = rx_queue_[(rx_head_ + rx_count_) % kRxQueueCapacity];
+        slot = message;
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               scheduler_.Now().time_since_epoch()).count();
+        slot.timestamp.tv_sec = static_cast<decltype(slot.timestamp.tv_sec)>(ns / 1000000000LL);
+        slot.timestamp.tv_nsec = static_cast<decltype(slot.timestamp.tv_nsec)>(ns % 1000000000LL);
+        ++rx_count_;
+        return true;
+    }
+
+    bool Accepts(const CANAPI_Message_t &message) const {
+        if (filter_count_ == 0) {
+            return true;
+        }
+        if (message.xtd != 0 || message.rtr != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < filter_count_; ++i) {
+            if (filters_[i] == message.id) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    SimCanBus &bus_;
+    SimScheduler &scheduler_;
+    bool initialized_ = false;
+    bool started_ = false;
+    bool bus_off_ = false;
+    bool bus_error_ = false;
+    uint32_t tec_ = 0;
+    uint32_t rec_ = 0;
+    std::chrono::steady_clock::time_point online_at_{};
+    std::array<uint32_t, kMaxFilters> filters_{};
+    size_t filter_count_ = 0;
+    std::array<CANAPI_Message_t, kRxQueueCapacity> rx_queue_{};
+    size_t rx_head_ = 0;
+    size_t rx_count_ = 0;
+    std::function<void()> receive_handler_;
+};
+
+inline void SimCanBus::Abort(SimCanBackend *sender) {
+    size_t kept = 0;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (pending_[i].sender != sender) {
+            pending_[kept++] = pending_[i];
+        }
+    }
+    pending_.resize(kept);
+}
+
+inline void SimCanBus::StartNext() {
+    if (pending_.empty()) {
+        busy_ = false;
+        return;
+    }
+    // Arbitration: lowest ID wins; a node sends its own frames in order.
+    size_t winner = 0;
+    for (size_t i = 1; i < pending_.size(); ++i) {
+        const Pending &a = pending_[i];
+        const Pending &b = pending_[winner];
+        if (a.message.id < b.message.id || (a.message.id == b.message.id && a.sequence < b.sequence)) {
+            winner = i;
+        }
+    }
+    in_flight_ = pending_[winner];
+    pending_.erase(pending_.begin() + static_cast<std::ptrdiff_t>(winner));
+
+    const CANAPI_Message_t &message = in_flight_.message;
+    const uint32_t bits = ExactFrameBits(message.id, message.xtd != 0, message.rtr != 0, message.dlc, message.data);
+    const std::chrono::nanoseconds duration(static_cast<int64_t>(bits) * 1000000000LL / bits_per_second_);
+    busy_ = true;
+    transmitting_ = true;
+    in_flight_end_ = scheduler_.Now() + duration;
+    busy_time_ += duration;
+    if (error_armed_) {
+        // An error raised on an idle bus hits the next frame halfway through.
+        error_armed_ = false;
+        const uint64_t generation = generation_;
+        scheduler_.After(duration / 2, [this, generation]() {
+            if (generation == generation_) {
+                DestroyInFlight();
+            }
+        });
+    }
+    const uint64_t generation = generation_;
+    scheduler_.After(duration, [this, generation]() { Complete(generation); });
+}
+
+inline void SimCanBus::Complete(uint64_t generation) {
+    if (generation != generation_) {
+        return;
+    }
+    transmitting_ = false;
+    ++frames_;
+    in_flight_.sender->OnTransmitted();
+    if (scheduler_.Now() < cut_end_) {
+        ++lost_;
+        StartNext();
+        return;
+    }
+    if (delivery_delay_.count() == 0 && delivery_jitter_.count() == 0) {
+        DeliverToReceivers(in_flight_.message, in_flight_.sender);
+    } else {
+        std::chrono::nanoseconds delay = delivery_delay_;
+        if (delivery_jitter_.count() > 0) {
+            delay += std::chrono::nanoseconds(
+                static_cast<int64_t>(NextRandom() % static_cast<uint64_t>(delivery_jitter_.count() + 1)));
+        }
+        // A receive path is a queue: a frame never overtakes the one before it.
+        std::chrono::steady_clock::time_point when = scheduler_.Now() + delay;
+        if (when < last_delivery_) {
+            when = last_delivery_;
+        }
+        last_delivery_ = when;
+        const CANAPI_Message_t message = in_flight_.message;
+        const SimCanBackend *sender = in_flight_.sender;
+        scheduler_.At(when, [this, message, sender]() { DeliverToReceivers(message, sender); });
+    }
+    StartNext();
+}
+
+inline void SimCanBus::DeliverToReceivers(const CANAPI_Message_t &message, const SimCanBackend *sender) {
+    for (SimCanBackend *node : nodes_) {
+        if (node != sender) {
+            node->Deliver(message);
+        }
+    }
+}
+
+// SplitMix64.
+inline uint64_t SimCanBus::NextRandom() {
+    uint64_t z = (random_state_ += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+inline void SimCanBus::StormTick() {
+    if (scheduler_.Now() >= storm_end_) {
+        return;
+    }
+    if (transmitting_) {
+        DestroyInFlight();
+    } else {
+        error_armed_ = true;
+    }
+    scheduler_.After(storm_interval_, [this]() { StormTick(); });
+}
+
+inline void SimCanBus::DestroyInFlight() {
+    ++generation_;
+    ++errors_;
+    transmitting_ = false;
+    const std::chrono::nanoseconds error_frame(static_cast<int64_t>(kErrorFrameBits) * 1000000000LL /
+                                               bits_per_second_);
+    busy_time_ -= std::chrono::duration_cast<std::chrono::nanoseconds>(in_flight_end_ - scheduler_.Now());
+    busy_time_ += error_frame;
+
+    SimCanBackend *sender = in_flight_.sender;
+    for (SimCanBackend *node : nodes_) {
+        node->OnBusError(node == sender);
+    }
+    // Automatic retransmission, unless the error took the sender bus-off.
+    if (sender->BusOff()) {
+        Abort(sender);
+    } else {
+        Queue(in_flight_);
+    }
+    scheduler_.After(error_frame, [this]() { StartNext(); });
+    for (SimCanBackend *node : nodes_) {
+        node->NotifyReceived();
+    }
+}
+
+}  // namespace raildoor
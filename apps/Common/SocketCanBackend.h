@@ -0,0 +1,477 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include <linux/can/raw.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "CanBackend.h"
+
+namespace raildoor {
+
+// CanBackend over Linux SocketCAN (CAN_RAW).
+//
+// - recvmmsg/sendmmsg move up to kMaxBatch frames per syscall. The rx path first tries a
+//   non-blocking recvmmsg and only polls when the queue is empty, so a loaded bus costs one
+//   syscall per batch.
+// - A read of one frame is a single blocking recvmsg with SO_RCVTIMEO as the timeout: the classic
+//   one-frame-per-call pattern, one syscall per frame, as a fair baseline for the batched path.
+// - SetReceiveFilter installs CAN_RAW_FILTER, so frames the app ignores never leave the kernel.
+// - SO_TIMESTAMPING stamps each frame in the kernel on arrival; ReceiveTime maps that stamp onto
+//   steady_clock instead of using the time the rx loop got around to the frame.
+// - SO_RXQ_OVFL reports socket-queue drops in stats.rx_dropped.
+// - Controller error frames are received (CAN_RAW_ERR_FILTER) and folded into the status
+//   GetStatus returns, since SocketCAN has no status query of its own.
+//
+// Bit timing is owned by the kernel (ip link set can0 type can bitrate 500000); the --bitrate
+// string is only validated here. So is bus-off recovery: the kernel restarts the controller after
+// restart-ms (ip link set can0 type can restart-ms 100), ResetController reports CANERR_NOTSUPP,
+// and StartController only reports whether the kernel has restarted it. All batch buffers are members, so steady-state I/O is
+// allocation-free.
+class SocketCanBackend final : public CanBackend {
+public:
+    static constexpr size_t kMaxBatch = 32;
+    static constexpr size_t kMaxFilters = 16;
+
+    ~SocketCanBackend() override {
+        TeardownChannel();
+    }
+
+    const char *Name() const override {
+        return "SocketCAN";
+    }
+
+    bool IsValidChannel(const std::string &channel) const override {
+        return !channel.empty() && channel.size() < IFNAMSIZ;
+    }
+
+    CANAPI_Return_t ParseBitrate(const std::string &text, CANAPI_Bitrate_t &bitrate) const override {
+        for (const BitrateEntry &entry : kBitrates) {
+            if (text == entry.text || std::strtoul(text.c_str(), nullptr, 10) == entry.bits_per_second) {
+                bitrate = CANAPI_Bitrate_t{};
+                bitrate.index = entry.index;
+                return CANERR_NOERROR;
+            }
+        }
+        return CANERR_BAUDRATE;
+    }
+
+    CANAPI_Return_t BitsPerSecond(const CANAPI_Bitrate_t &bitrate, uint32_t &bits_per_second) const override {
+        for (const BitrateEntry &entry : kBitrates) {
+            if (bitrate.index == entry.index) {
+                bits_per_second = static_cast<uint32_t>(entry.bits_per_second);
+                return CANERR_NOERROR;
+            }
+        }
+        return CANERR_BAUDRATE;
+    }
+
+    CANAPI_Return_t InitializeChannel(const std::string &channel) override {
+        if (fd_ >= 0) {
+            return CANERR_YETINIT;
+        }
+        if (!IsValidChannel(channel)) {
+            return CANERR_ILLPARA;
+        }
+
+        int fd = ::socket(PF_CAN, SOCK_RAW, CAN_RAW);
+        if (fd < 0) {
+            return FromErrno(errno);
+        }
+
+        ifreq ifr{};
+        std::strncpy(ifr.ifr_name, channel.c_str(), IFNAMSIZ - 1);
+        if (::ioctl(fd, SIOCGIFINDEX, &ifr) < 0) {
+            int err = errno;
+            ::close(fd);
+            return FromErrno(err);
+        }
+
+        // Bus errors (CAN_ERR_PROT/BUSERROR) only arrive if the driver has berr-reporting on.
+        can_err_mask_t err_mask = CAN_ERR_TX_TIMEOUT | CAN_ERR_CRTL | CAN_ERR_PROT | CAN_ERR_ACK | CAN_ERR_BUSOFF |
+                                  CAN_ERR_BUSERROR | CAN_ERR_RESTARTED;
+        int ts_flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        int enable = 1;
+        sockaddr_can addr{};
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        if (::setsockopt(fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask)) < 0 ||
+            ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &ts_flags, sizeof(ts_flags)) < 0 ||
+            ::setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) < 0 ||
+            ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+            int err = errno;
+            ::close(fd);
+            return FromErrno(err);
+        }
+
+        for (size_t i = 0; i < kMaxBatch; ++i) {
+            rx_iov_[i].iov_base = &rx_frames_[i];
+            rx_iov_[i].iov_len = sizeof(can_frame);
+            rx_msgs_[i].msg_hdr = msghdr{};
+            rx_msgs_[i].msg_hdr.msg_iov = &rx_iov_[i];
+            rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+            rx_msgs_[i].msg_hdr.msg_control = rx_control_[i];
+
+            tx_iov_[i].iov_base = &tx_frames_[i];
+            tx_iov_[i].iov_len = sizeof(can_frame);
+            tx_msgs_[i].msg_hdr = msghdr{};
+            tx_msgs_[i].msg_hdr.msg_iov = &tx_iov_[i];
+            tx_msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        std::memcpy(ifname_, ifr.ifr_name, sizeof(ifname_));
+        fd_ = fd;
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t StartController(const CANAPI_Bitrate_t &bitrate) override {
+        (void)bitrate;
+        if (fd_ < 0) {
+            return CANERR_NOTINIT;
+        }
+        ifreq ifr{};
+        std::memcpy(ifr.ifr_name, ifname_, sizeof(ifr.ifr_name));
+        if (::ioctl(fd_, SIOCGIFFLAGS, &ifr) < 0) {
+            return FromErrno(errno);
+        }
+        if ((ifr.ifr_flags & IFF_UP) == 0) {
+            return CANERR_OFFLINE;
+        }
+        // A CAN interface drops its carrier while bus-off and raises it again on restart, which
+        // also covers a CAN_ERR_RESTARTED frame lost to a full socket queue.
+        if ((ifr.ifr_flags & IFF_RUNNING) == 0) {
+            return CANERR_BOFF;
+        }
+        status_.bus_off = 0;
+        return CANERR_NOERROR;
+    }
+
+    // Restarting needs CAP_NET_ADMIN (ip link set can0 type can restart), so the socket is left
+    // alone. The health engine then only waits for the kernel's own bus-off restart and does not
+    // count a restart that never happened.
+    CANAPI_Return_t ResetController() override {
+        return fd_ < 0 ? CANERR_NOTINIT : CANERR_NOTSUPP;
+    }
+
+    CANAPI_Return_t TeardownChannel() override {
+        if (fd_ < 0) {
+            return CANERR_NOTINIT;
+        }
+        ::close(fd_);
+        fd_ = -1;
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t SetReceiveFilter(const uint32_t *ids, size_t count) override {
+        if (fd_ < 0) {
+            return CANERR_NOTINIT;
+        }
+        if (count > kMaxFilters) {
+            return CANERR_ILLPARA;
+        }
+        can_filter filters[kMaxFilters]{};
+        for (size_t i = 0; i < count; ++i) {
+            // Matching EFF and RTR flags in the mask rejects extended and remote frames too.
+            filters[i].can_id = ids[i] & CAN_SFF_MASK;
+            filters[i].can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        }
+        if (::setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FILTER, filters,
+                         static_cast<socklen_t>(count * sizeof(can_filter))) < 0) {
+            return FromErrno(errno);
+        }
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t ReadMessages(CANAPI_Message_t *messages, size_t capacity, size_t &count,
+                                 uint16_t timeout_ms) override {
+        count = 0;
+        if (fd_ < 0) {
+            return CANERR_NOTINIT;
+        }
+        const unsigned int batch = static_cast<unsigned int>(std::min(capacity, kMaxBatch));
+        if (batch == 0) {
+            return CANERR_ILLPARA;
+        }
+        if (batch == 1) {
+            return ReadOne(messages[0], count, timeout_ms);
+        }
+
+        int received = ReceiveBatch(batch);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (timeout_ms == 0) {
+                return CANERR_RX_EMPTY;
+            }
+            pollfd pfd{};
+            pfd.fd = fd_;
+            pfd.events = POLLIN;
+            int ready = ::poll(&pfd, 1, timeout_ms == CANWAIT_INFINITE ? -1 : static_cast<int>(timeout_ms));
+            stats_.rx_calls.fetch_add(1, std::memory_order_relaxed);
+            if (ready == 0 || (ready < 0 && errno == EINTR)) {
+                return CANERR_TIMEOUT;
+            }
+            if (ready < 0) {
+                return FromErrno(errno);
+            }
+            received = ReceiveBatch(batch);
+        }
+        if (received < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? CANERR_RX_EMPTY : FromErrno(errno);
+        }
+
+        // Map CLOCK_REALTIME kernel stamps onto steady_clock. Sampling the offset per batch keeps
+        // it current across wall-clock adjustments.
+        realtime_offset_ns_ = RealtimeNs() - SteadyNs();
+        for (int i = 0; i < received; ++i) {
+            ConvertFrame(rx_frames_[i], rx_msgs_[i].msg_hdr, messages[i]);
+        }
+        count = static_cast<size_t>(received);
+        stats_.rx_frames.fetch_add(count, std::memory_order_relaxed);
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t WriteMessages(const CANAPI_Message_t *messages, size_t count, size_t &written) override {
+        written = 0;
+        if (fd_ < 0) {
+            return CANERR_NOTINIT;
+        }
+        while (written < count) {
+            const size_t batch = std::min(count - written, kMaxBatch);
+            for (size_t i = 0; i < batch; ++i) {
+                const CANAPI_Message_t &message = messages[written + i];
+                can_frame &frame = tx_frames_[i];
+                std::memset(&frame, 0, sizeof(frame));
+                frame.can_id = message.xtd ? ((message.id & CAN_EFF_MASK) | CAN_EFF_FLAG)
+                                           : (message.id & CAN_SFF_MASK);
+                if (message.rtr) {
+                    frame.can_id |= CAN_RTR_FLAG;
+                }
+                frame.can_dlc = std::min<uint8_t>(message.dlc, CAN_MAX_DLEN);
+                std::memcpy(frame.data, message.data, frame.can_dlc);
+            }
+            int sent = ::sendmmsg(fd_, tx_msgs_, static_cast<unsigned int>(batch), MSG_DONTWAIT);
+            stats_.tx_calls.fetch_add(1, std::memory_order_relaxed);
+            if (sent < 0) {
+                return (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) ? CANERR_TX_BUSY
+                                                                                    : FromErrno(errno);
+            }
+            written += static_cast<size_t>(sent);
+            stats_.tx_frames.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+            if (static_cast<size_t>(sent) < batch) {
+                return CANERR_TX_BUSY;
+            }
+        }
+        return CANERR_NOERROR;
+    }
+
+    CANAPI_Return_t GetStatus(CANAPI_Status_t &status) override {
+        if (fd_ < 0) {
+            return CANERR_NOTINIT;
+        }
+        status = status_;
+        status_.bus_error = 0;
+        status_.queue_overrun = 0;
+        return CANERR_NOERROR;
+    }
+
+    std::chrono::steady_clock::time_point ReceiveTime(const CANAPI_Message_t &message) const override {
+        const int64_t realtime_ns = static_cast<int64_t>(message.timestamp.tv_sec) * 1000000000LL +
+                                    static_cast<int64_t>(message.timestamp.tv_nsec);
+        return std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(realtime_ns - realtime_offset_ns_)));
+    }
+
+    int LastErrno() const {
+        return last_errno_;
+    }
+
+private:
+    struct BitrateEntry {
+        const char *text;
+        int32_t index;
+        unsigned long bits_per_second;
+    };
+
+    static constexpr BitrateEntry kBitrates[] = {
+        {"1M", CANBTR_INDEX_1M, 1000000UL},     {"800k", CANBTR_INDEX_800K, 800000UL},
+        {"500k", CANBTR_INDEX_500K, 500000UL},  {"250k", CANBTR_INDEX_250K, 250000UL},
+        {"125k", CANBTR_INDEX_125K, 125000UL},  {"100k", CANBTR_INDEX_100K, 100000UL},
+        {"50k", CANBTR_INDEX_50K, 50000UL},     {"20k", CANBTR_INDEX_20K, 20000UL},
+        {"10k", CANBTR_INDEX_10K, 10000UL}};
+
+    static constexpr size_t kControlSize =
+        CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(uint32_t));
+
+    static int64_t RealtimeNs() {
+        timespec ts{};
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+    }
+
+    static int64_t SteadyNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    int ReceiveBatch(unsigned int batch) {
+        for (unsigned int i = 0; i < batch; ++i) {
+            // The kernel shrinks msg_controllen to what it wrote, so reset it every call.
+            rx_msgs_[i].msg_hdr.msg_controllen = kControlSize;
+            rx_msgs_[i].msg_hdr.msg_flags = 0;
+        }
+        int received = ::recvmmsg(fd_, rx_msgs_, batch, MSG_DONTWAIT, nullptr);
+        stats_.rx_calls.fetch_add(1, std::memory_order_relaxed);
+        return received;
+    }
+
+    CANAPI_Return_t ReadOne(CANAPI_Message_t &message, size_t &count, uint16_t timeout_ms) {
+        // The socket is blocking; SO_RCVTIMEO bounds the wait, and is only reset when it changes.
+        if (timeout_ms != 0 && timeout_ms != rcvtimeo_ms_) {
+            timeval tv{};
+            if (timeout_ms != CANWAIT_INFINITE) {
+                tv.tv_sec = timeout_ms / 1000;
+                tv.tv_usec = static_cast<suseconds_t>(timeout_ms % 1000) * 1000;
+            }
+            if (::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+                return FromErrno(errno);
+            }
+            rcvtimeo_ms_ = timeout_ms;
+        }
+        msghdr &header = rx_msgs_[0].msg_hdr;
+        header.msg_controllen = kControlSize;
+        header.msg_flags = 0;
+        const ssize_t received = ::recvmsg(fd_, &header, timeout_ms == 0 ? MSG_DONTWAIT : 0);
+        stats_.rx_calls.fetch_add(1, std::memory_order_relaxed);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return timeout_ms == 0 ? CANERR_RX_EMPTY : CANERR_TIMEOUT;
+            }
+            return FromErrno(errno);
+        }
+        realtime_offset_ns_ = RealtimeNs() - SteadyNs();
+        ConvertFrame(rx_frames_[0], header, message);
+        count = 1;
+        stats_.rx_frames.fetch_add(1, std::memory_order_relaxed);
+        return CANERR_NOERROR;
+    }
+
+    void ConvertFrame(const can_frame &frame, msghdr &header, CANAPI_Message_t &message) {
+        message = CANAPI_Message_t{};
+        message.xtd = (frame.can_id & CAN_EFF_FLAG) ? 1 : 0;
+        message.rtr = (frame.can_id & CAN_RTR_FLAG) ? 1 : 0;
+        message.sts = (frame.can_id & CAN_ERR_FLAG) ? 1 : 0;
+        message.id = frame.can_id & (message.xtd ? CAN_EFF_MASK : CAN_SFF_MASK);
+        message.dlc = std::min<uint8_t>(frame.can_dlc, CAN_MAX_DLEN);
+        std::memcpy(message.data, frame.data, message.dlc);
+        if (message.sts) {
+            NoteErrorFrame(frame);
+        }
+
+        bool stamped = false;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr; cmsg = CMSG_NXTHDR(&header, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET) {
+                continue;
+            }
+            if (cmsg->cmsg_type == SO_TIMESTAMPING) {
+                scm_timestamping stamps{};
+                std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                message.timestamp.tv_sec = stamps.ts[0].tv_sec;
+                message.timestamp.tv_nsec = stamps.ts[0].tv_nsec;
+                stamped = true;
+            } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t dropped = 0;
+                std::memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                stats_.rx_dropped.store(dropped, std::memory_order_relaxed);
+            }
+        }
+        if (!stamped) {
+            const int64_t now_ns = RealtimeNs();
+            message.timestamp.tv_sec = static_cast<decltype(message.timestamp.tv_sec)>(now_ns / 1000000000LL);
+            message.timestamp.tv_nsec = static_cast<decltype(message.timestamp.tv_nsec)>(now_ns % 1000000000LL);
+        }
+    }
+
+    // Bus-off latches until the restart; warning/passive until the controller reports error-active
+    // again; bus errors and overruns until the next GetStatus.
+    void NoteErrorFrame(const can_frame &frame) {
+        if (frame.can_id & CAN_ERR_BUSOFF) {
+            status_.bus_off = 1;
+        }
+        if (frame.can_id & CAN_ERR_RESTARTED) {
+            status_.bus_off = 0;
+            status_.warning_level = 0;
+        }
+        if (frame.can_id & (CAN_ERR_PROT | CAN_ERR_BUSERROR | CAN_ERR_ACK | CAN_ERR_TX_TIMEOUT)) {
+            status_.bus_error = 1;
+        }
+        if (frame.can_id & CAN_ERR_CRTL) {
+            const uint8_t controller = frame.data[1];
+            if (controller & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING | CAN_ERR_CRTL_RX_PASSIVE |
+                              CAN_ERR_CRTL_TX_PASSIVE)) {
+                status_.warning_level = 1;
+            }
+            if (controller & CAN_ERR_CRTL_ACTIVE) {
+                status_.warning_level = 0;
+            }
+            if (controller & (CAN_ERR_CRTL_RX_OVERFLOW | CAN_ERR_CRTL_TX_OVERFLOW)) {
+                status_.queue_overrun = 1;
+            }
+        }
+    }
+
+    CANAPI_Return_t FromErrno(int err) {
+        last_errno_ = err;
+        switch (err) {
+            case ENODEV:
+            case ENXIO:
+                return CANERR_HANDLE;
+            case ENETDOWN:
+                return CANERR_OFFLINE;
+            case ENOBUFS:
+            case EAGAIN:
+                return CANERR_TX_BUSY;
+            case EINVAL:
+                return CANERR_ILLPARA;
+            case EAFNOSUPPORT:
+            case EPROTONOSUPPORT:
+                return CANERR_NOTSUPP;
+            default:
+                return CANERR_FATAL;
+        }
+    }
+
+    int fd_ = -1;
+    char ifname_[IFNAMSIZ]{};
+    int last_errno_ = 0;
+    int64_t realtime_offset_ns_ = 0;
+    uint16_t rcvtimeo_ms_ = 0;  // SO_RCVTIMEO currently set, 0 for none yet
+    CANAPI_Status_t status_{};
+
+    can_frame rx_frames_[kMaxBatch]{};
+    iovec rx_iov_[kMaxBatch]{};
+    mmsghdr rx_msgs_[kMaxBatch]{};
+    alignas(cmsghdr) unsigned char rx_control_[kMaxBatch][kControlSize]{};
+
+    can_frame tx_frames_[kMaxBatch]{};
+    iovec tx_iov_[kMaxBatch]{};
+    mmsghdr tx_msgs_[kMaxBatch]{};
+};
+
+}  // namespace raildoor
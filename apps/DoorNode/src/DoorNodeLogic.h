@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "CANAPI_Types.h"
+
+#include "DoorProtocol.h"
+#include "Logging.h"
+
+namespace raildoor {
+
+// Door state machine of one DoorNode. Time is passed in rather than read, so the same code runs
+// under DoorNode's threads and under DoorSim's virtual clock. Not thread-safe: DoorNode holds its
+// status mutex around every call.
+class DoorNodeLogic {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    DoorNodeLogic(const char *log_prefix, int door_id, std::chrono::milliseconds move_time, uint8_t obstruction)
+        : log_prefix_(log_prefix), door_id_(door_id), move_time_(move_time) {
+        status_.obstruction = obstruction;
+    }
+
+    // Applies a command frame addressed to this door; anything else is ignored. Returns true if a
+    // move was started, in which case Poll() must run once MoveDeadline() has passed.
+    bool OnFrame(const CANAPI_Message_t &message, time_point now) {
+        if (message.sts != 0 || message.xtd != 0 || message.rtr != 0) {
+            return false;
+        }
+        if (message.id != kCommandId || message.dlc < 2) {
+            return false;
+        }
+        uint8_t door_id = message.data[0];
+        uint8_t cmd = message.data[1];
+        if (door_id != door_id_) {
+            return false;
+        }
+
+        if (cmd == kCommandOpen) {
+            if (status_.state == DoorState::Closed) {
+                Log(log_prefix_, "Command OPEN received");
+                StartMove(DoorState::Open, now);
+                return true;
+            }
+        } else if (cmd == kCommandClose) {
+            if (status_.state == DoorState::Open) {
+                Log(log_prefix_, "Command CLOSE received");
+                StartMove(DoorState::Closed, now);
+                return true;
+            }
+        } else if (cmd == kCommandResetFault) {
+            // As before the refactor, a reset does not cancel a move in progress.
+            Log(log_prefix_, "Command RESET_FAULT received");
+            SetFault(0);
+            SetState(DoorState::Closed);
+        }
+        return false;
+    }
+
+    // Completes the pending move if its deadline has passed.
+    void Poll(time_point now) {
+        if (move_pending_ && now >= move_deadline_) {
+            move_pending_ = false;
+            SetState(move_target_);
+        }
+    }
+
+    bool MovePending() const {
+        return move_pending_;
+    }
+
+    time_point MoveDeadline() const {
+        return move_deadline_;
+    }
+
+    const DoorStatus &Status() const {
+        return status_;
+    }
+
+    CANAPI_Message_t StatusMessage() const {
+        return BuildStatusMessage(door_id_, status_);
+    }
+
+    // Latches a fault and cancels any move. DoorNode has no fault source of its own yet; DoorSim
+    // uses this to script fault scenarios.
+    void InjectFault(uint8_t fault_code) {
+        move_pending_ = false;
+        SetFault(fault_code);
+        SetState(DoorState::Faulted);
+    }
+
+private:
+    void StartMove(DoorState target, time_point now) {
+        SetState(DoorState::Moving);
+        // A new move replaces the pending one.
+        move_pending_ = true;
+        move_target_ = target;
+        move_deadline_ = now + move_time_;
+    }
+
+    void SetState(DoorState next) {
+        if (status_.state != next) {
+            status_.state = next;
+            Log(log_prefix_, "Door state -> %s", DoorStateToString(next));
+        }
+    }
+
+    void SetFault(uint8_t fault_code) {
+        if (status_.fault_code != fault_code) {
+            status_.fault_code = fault_code;
+            Log(log_prefix_, "Fault code -> %u", static_cast<unsigned>(fault_code));
+        }
+    }
+
+    const char *log_prefix_;
+    int door_id_;
+    std::chrono::milliseconds move_time_;
+    DoorStatus status_;
+    bool move_pending_ = false;
+    DoorState move_target_ = DoorState::Closed;
+    time_point move_deadline_{};
+};
+
+}  // namespace raildoor
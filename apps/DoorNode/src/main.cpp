@@ -1,47 +1,45 @@
+#include <array>
 #include <atomic>
 #include <chrono>
-#include <cctype>
+#include <csignal>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
-#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <sstream>
 #include <string>
 #include <thread>
-#include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
-#include "PeakCAN.h"
-#include "PCANBasic.h"
+#include "AllocationTracker.h"
+#include "CanErrors.h"
+#include "Clock.h"
+#include "ControllerHealth.h"
+#include "CpuTime.h"
+#include "DoorNodeLogic.h"
+#include "DoorProtocol.h"
+#include "Logging.h"
+#include "PlatformCanBackend.h"
 
 namespace {
-constexpr uint32_t kCommandId = 0x201U;
-constexpr uint32_t kStatusIdBase = 0x101U;
-constexpr int kExitFailure = 2;
+using namespace raildoor;
 
-enum class DoorState : uint8_t {
-    Closed = 0,
-    Open = 1,
-    Moving = 2,
-    Faulted = 3
-};
+constexpr int kExitFailure = 2;
+constexpr int kExitAllocations = 3;
+constexpr size_t kRxBatch = 8;
 
 struct Config {
     int door_id = 0;
-    std::string channel = "PCAN_USBBUS1";
+    std::string channel = kDefaultChannel;
     std::string bitrate = "500k";
     int period_ms = 100;
     int move_ms = 2000;
-    uint8_t obstruction = 0;
-};
-
-struct DoorStatus {
-    DoorState state = DoorState::Closed;
-    uint8_t fault_code = 0;
+    int duration_s = 0;
     uint8_t obstruction = 0;
 };
 
@@ -55,117 +53,11 @@ BOOL WINAPI ConsoleHandler(DWORD type) {
     }
     return FALSE;
 }
-#endif
-
-std::string Timestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-    std::tm tm_snapshot{};
-#ifdef _WIN32
-    localtime_s(&tm_snapshot, &time);
 #else
-    localtime_r(&time, &tm_snapshot);
-#endif
-    std::ostringstream oss;
-    oss << std::put_time(&tm_snapshot, "%H:%M:%S") << '.' << std::setw(3) << std::setfill('0')
-        << ms.count();
-    return oss.str();
-}
-
-void Log(const std::string &prefix, const std::string &message) {
-    std::cout << "[" << Timestamp() << "] " << prefix << " " << message << std::endl;
-}
-
-void LogError(const std::string &prefix, const std::string &message) {
-    std::cerr << "[" << Timestamp() << "] " << prefix << " ERROR: " << message << std::endl;
-}
-
-std::string DoorStateToString(DoorState state) {
-    switch (state) {
-        case DoorState::Closed:
-            return "CLOSED";
-        case DoorState::Open:
-            return "OPEN";
-        case DoorState::Moving:
-            return "MOVING";
-        case DoorState::Faulted:
-            return "FAULTED";
-        default:
-            return "UNKNOWN";
-    }
-}
-
-struct RateLimiter {
-    std::chrono::steady_clock::time_point last_log{};
-    size_t suppressed = 0;
-};
-
-void LogRateLimited(const std::string &prefix,
-                    const std::string &message,
-                    RateLimiter &limiter,
-                    std::chrono::milliseconds interval) {
-    auto now = std::chrono::steady_clock::now();
-    if (limiter.last_log.time_since_epoch().count() == 0 ||
-        now - limiter.last_log >= interval) {
-        std::string suffix;
-        if (limiter.suppressed > 0) {
-            suffix = " (" + std::to_string(limiter.suppressed) + " similar errors suppressed)";
-            limiter.suppressed = 0;
-        }
-        Log(prefix, message + suffix);
-        limiter.last_log = now;
-    } else {
-        ++limiter.suppressed;
-    }
-}
-
-std::string ErrorToString(CANAPI_Return_t rc) {
-    switch (rc) {
-        case CANERR_NOERROR:
-            return "OK";
-        case CANERR_RX_EMPTY:
-            return "RX_EMPTY";
-        case CANERR_TIMEOUT:
-            return "TIMEOUT";
-        case CPeakCAN::DriverNotLoaded:
-            return "PCAN driver not loaded";
-        case CPeakCAN::HardwareAlreadyInUse:
-            return "PCAN hardware already in use";
-        case CPeakCAN::ClientAlreadyConnected:
-            return "PCAN client already connected";
-        case CPeakCAN::RegisterTestFailed:
-            return "PCAN hardware not found";
-        default:
-            return "CAN error " + std::to_string(rc);
-    }
-}
-
-bool TryParseChannel(const std::string &text, uint32_t &channel) {
-    if (text.rfind("PCAN_USBBUS", 0) == 0) {
-        std::string suffix = text.substr(std::string("PCAN_USBBUS").size());
-        int index = std::atoi(suffix.c_str());
-        static const uint32_t kUsbMap[] = {
-            PCAN_USBBUS1,  PCAN_USBBUS2,  PCAN_USBBUS3,  PCAN_USBBUS4,
-            PCAN_USBBUS5,  PCAN_USBBUS6,  PCAN_USBBUS7,  PCAN_USBBUS8,
-            PCAN_USBBUS9,  PCAN_USBBUS10, PCAN_USBBUS11, PCAN_USBBUS12,
-            PCAN_USBBUS13, PCAN_USBBUS14, PCAN_USBBUS15, PCAN_USBBUS16};
-        if (index >= 1 && index <= 16) {
-            channel = kUsbMap[index - 1];
-            return true;
-        }
-    }
-
-    if (!text.empty() && (std::isdigit(static_cast<unsigned char>(text[0])) || text.rfind("0x", 0) == 0)) {
-        try {
-            channel = static_cast<uint32_t>(std::stoul(text, nullptr, 0));
-            return true;
-        } catch (...) {
-            return false;
-        }
-    }
-    return false;
+void SignalHandler(int) {
+    g_running = false;
 }
+#endif
 
 bool ParseArgs(int argc, char **argv, Config &config) {
     for (int i = 1; i < argc; ++i) {
@@ -180,6 +72,8 @@ bool ParseArgs(int argc, char **argv, Config &config) {
             config.period_ms = std::atoi(argv[++i]);
         } else if (arg == "--move_ms" && i + 1 < argc) {
             config.move_ms = std::atoi(argv[++i]);
+        } else if (arg == "--duration_s" && i + 1 < argc) {
+            config.duration_s = std::atoi(argv[++i]);
         } else if (arg == "--obstruction" && i + 1 < argc) {
             config.obstruction = static_cast<uint8_t>(std::atoi(argv[++i]));
         } else {
@@ -198,6 +92,11 @@ bool ParseArgs(int argc, char **argv, Config &config) {
         return false;
     }
 
+    if (config.duration_s < 0) {
+        std::cerr << "--duration_s must be >= 0" << std::endl;
+        return false;
+    }
+
     if (config.obstruction > 1) {
         std::cerr << "--obstruction must be 0 or 1" << std::endl;
         return false;
@@ -206,26 +105,9 @@ bool ParseArgs(int argc, char **argv, Config &config) {
     return true;
 }
 
-CANAPI_Message_t BuildStatusMessage(int door_id, const DoorStatus &status) {
-    CANAPI_Message_t message{};
-    message.id = kStatusIdBase + static_cast<uint32_t>(door_id - 1);
-    message.xtd = 0;
-    message.rtr = 0;
-    message.sts = 0;
-    message.dlc = 8;
-    message.data[0] = static_cast<uint8_t>(status.state);
-    message.data[1] = status.obstruction;
-    message.data[2] = status.fault_code;
-    message.data[3] = static_cast<uint8_t>(door_id);
-    for (int i = 4; i < 8; ++i) {
-        message.data[i] = 0;
-    }
-    return message;
-}
-
 void PrintUsage() {
-    std::cout << "DoorNode.exe --id <1..3> [--channel PCAN_USBBUS1] [--bitrate 500k]"
-              << " [--period_ms 100] [--move_ms 2000] [--obstruction 0|1]" << std::endl;
+    std::cout << "DoorNode.exe --id <1..3> [--channel PCAN_USBBUS1|can0] [--bitrate 500k]"
+              << " [--period_ms 100] [--move_ms 2000] [--obstruction 0|1] [--duration_s 0]" << std::endl;
 }
 }  // namespace
 
@@ -235,173 +117,185 @@ int main(int argc, char **argv) {
         PrintUsage();
         return kExitFailure;
     }
-    const std::string log_prefix = "DoorNode[" + std::to_string(config.door_id) + "]";
+    char log_prefix[32];
+    std::snprintf(log_prefix, sizeof(log_prefix), "DoorNode[%d]", config.door_id);
 
 #ifdef _WIN32
     SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+#else
+    std::signal(SIGINT, SignalHandler);
+    std::signal(SIGTERM, SignalHandler);
 #endif
 
-    uint32_t channel = 0;
-    if (!TryParseChannel(config.channel, channel)) {
-        LogError(log_prefix, "Invalid channel string: " + config.channel);
+    std::unique_ptr<CanBackend> can_api = CreatePlatformCanBackend();
+    if (!can_api->IsValidChannel(config.channel)) {
+        LogError(log_prefix, "Invalid channel string: %s", config.channel.c_str());
         return kExitFailure;
     }
 
     CANAPI_Bitrate_t bitrate{};
-    bool data = false;
-    bool sam = false;
-    CANAPI_Return_t rc = CPeakCAN::MapString2Bitrate(config.bitrate.c_str(), bitrate, data, sam);
+    CANAPI_Return_t rc = can_api->ParseBitrate(config.bitrate, bitrate);
     if (rc != CANERR_NOERROR) {
-        LogError(log_prefix, "Invalid bitrate string: " + config.bitrate);
+        LogError(log_prefix, "Invalid bitrate string: %s", config.bitrate.c_str());
         return kExitFailure;
     }
 
-    CPeakCAN can_api;
-    CANAPI_OpMode_t op_mode{};
-    op_mode.byte = static_cast<uint8_t>(CANMODE_DEFAULT | CANMODE_NXTD);
-
-    rc = can_api.InitializeChannel(static_cast<int32_t>(channel), op_mode);
+    rc = can_api->InitializeChannel(config.channel);
     if (rc != CANERR_NOERROR) {
-        LogError(log_prefix, "CAN init failed: " + ErrorToString(rc));
-        LogError(log_prefix, "Check that the PCAN driver is installed, the channel is valid, and not already in use.");
+        LogError(log_prefix, "CAN init failed: %s (rc=%d)", ErrorToString(rc), rc);
+        LogError(log_prefix, "Check that the %s driver is installed, the channel is valid, and not already in use.",
+                 can_api->Name());
         return kExitFailure;
     }
 
-    rc = can_api.StartController(bitrate);
+    rc = can_api->StartController(bitrate);
     if (rc != CANERR_NOERROR) {
-        LogError(log_prefix, "CAN start failed: " + ErrorToString(rc));
-        LogError(log_prefix, "Bitrate mismatch or CAN init failure. Verify the bus is at " + config.bitrate + ".");
-        can_api.TeardownChannel();
+        LogError(log_prefix, "CAN start failed: %s (rc=%d)", ErrorToString(rc), rc);
+        LogError(log_prefix, "Bitrate mismatch or CAN init failure. Verify the bus is at %s.", config.bitrate.c_str());
+        can_api->TeardownChannel();
         return kExitFailure;
     }
 
-    Log(log_prefix, "CAN init OK on " + config.channel + " @" + config.bitrate);
-    Log(log_prefix, "DoorNode started for door " + std::to_string(config.door_id));
+    const uint32_t rx_ids[] = {kCommandId};
+    rc = can_api->SetReceiveFilter(rx_ids, sizeof(rx_ids) / sizeof(rx_ids[0]));
+    if (rc != CANERR_NOERROR) {
+        // Not fatal: the rx loop still checks every ID in software.
+        LogError(log_prefix, "CAN receive filter failed: %s (rc=%d)", ErrorToString(rc), rc);
+    }
+
+    Log(log_prefix, "CAN init OK on %s @%s (%s)", config.channel.c_str(), config.bitrate.c_str(), can_api->Name());
+    Log(log_prefix, "DoorNode started for door %d", config.door_id);
 
+    SystemClock clock;
+    // One mutex guards the door logic; the motion thread waits on it for the move deadline.
     std::mutex status_mutex;
-    DoorStatus status;
-    status.obstruction = config.obstruction;
-    std::atomic<uint64_t> move_token{0};
+    std::condition_variable motion_cv;
+    DoorNodeLogic door(log_prefix, config.door_id, std::chrono::milliseconds(config.move_ms), config.obstruction);
     RateLimiter read_limiter;
     RateLimiter write_limiter;
-
-    auto set_state = [&](DoorState next) {
-        std::lock_guard<std::mutex> lock(status_mutex);
-        if (status.state != next) {
-            status.state = next;
-            Log(log_prefix, "Door state -> " + DoorStateToString(next));
+    // The rx thread services controller health; the tx thread reports write results into it.
+    std::mutex health_mutex;
+    ControllerHealth health(log_prefix);
+    // Held by the tx thread around each write and by the rx thread around a controller restart.
+    std::mutex control_mutex;
+
+    // A single motion thread completes moves at their deadline. A new move replaces the pending
+    // one inside DoorNodeLogic, so no thread is spawned per command.
+    std::thread motion_thread([&]() {
+        std::unique_lock<std::mutex> lock(status_mutex);
+        while (g_running.load()) {
+            if (!door.MovePending()) {
+                motion_cv.wait_for(lock, std::chrono::milliseconds(100));
+                continue;
+            }
+            if (clock.Now() < door.MoveDeadline()) {
+                motion_cv.wait_until(lock, door.MoveDeadline());
+                continue;
+            }
+            door.Poll(clock.Now());
         }
-    };
+    });
 
-    auto set_fault = [&](uint8_t fault_code) {
-        std::lock_guard<std::mutex> lock(status_mutex);
-        if (status.fault_code != fault_code) {
-            status.fault_code = fault_code;
-            Log(log_prefix, "Fault code -> " + std::to_string(fault_code));
+    auto handle_command = [&](const CANAPI_Message_t &message) {
+        bool move_started = false;
+        {
+            std::lock_guard<std::mutex> lock(status_mutex);
+            move_started = door.OnFrame(message, clock.Now());
+        }
+        if (move_started) {
+            motion_cv.notify_one();
         }
     };
 
-    auto start_move = [&](DoorState target) {
-        uint64_t token = ++move_token;
-        set_state(DoorState::Moving);
-        std::thread([&, token, target]() {
-            std::this_thread::sleep_for(std::chrono::milliseconds(config.move_ms));
-            if (!g_running.load()) {
-                return;
-            }
-            if (move_token.load() != token) {
-                return;
-            }
-            set_state(target);
-        }).detach();
-    };
-
+    std::chrono::nanoseconds rx_cpu{0};
     std::thread rx_thread([&]() {
+        std::array<CANAPI_Message_t, kRxBatch> batch{};
         while (g_running.load()) {
-            CANAPI_Message_t message{};
-            CANAPI_Return_t rc_read = can_api.ReadMessage(message, 100U);
+            size_t count = 0;
+            CANAPI_Return_t rc_read = can_api->ReadMessages(batch.data(), batch.size(), count, 100U);
             if (rc_read == CANERR_NOERROR) {
-                if (message.sts != 0 || message.xtd != 0 || message.rtr != 0) {
-                    continue;
-                }
-                if (message.id != kCommandId || message.dlc < 2) {
-                    continue;
-                }
-                uint8_t door_id = message.data[0];
-                uint8_t cmd = message.data[1];
-                if (door_id != config.door_id) {
-                    continue;
+                for (size_t i = 0; i < count; ++i) {
+                    handle_command(batch[i]);
                 }
+            } else if (rc_read != CANERR_RX_EMPTY && rc_read != CANERR_TIMEOUT) {
+                LogRateLimited(log_prefix, read_limiter, std::chrono::milliseconds(1000),
+                               "CAN read error: %s (rc=%d)", ErrorToString(rc_read), rc_read);
+            }
 
-                if (cmd == 1) {
-                    DoorState current_state;
-                    {
-                        std::lock_guard<std::mutex> lock(status_mutex);
-                        current_state = status.state;
-                    }
-                    if (current_state == DoorState::Closed) {
-                        Log(log_prefix, "Command OPEN received");
-                        start_move(DoorState::Open);
-                    }
-                } else if (cmd == 2) {
-                    DoorState current_state;
-                    {
-                        std::lock_guard<std::mutex> lock(status_mutex);
-                        current_state = status.state;
-                    }
-                    if (current_state == DoorState::Open) {
-                        Log(log_prefix, "Command CLOSE received");
-                        start_move(DoorState::Closed);
-                    }
-                } else if (cmd == 3) {
-                    Log(log_prefix, "Command RESET_FAULT received");
-                    set_fault(0);
-                    set_state(DoorState::Closed);
+            std::lock_guard<std::mutex> lock(health_mutex);
+            const auto now = clock.Now();
+            for (size_t i = 0; i < count; ++i) {
+                if (batch[i].sts != 0) {
+                    health.OnErrorFrame(now);
+                } else {
+                    health.OnTraffic(now);
                 }
-            } else if (rc_read == CANERR_RX_EMPTY || rc_read == CANERR_TIMEOUT) {
-                continue;
-            } else {
-                LogRateLimited(log_prefix, "CAN read error: " + ErrorToString(rc_read), read_limiter,
-                               std::chrono::milliseconds(1000));
             }
+            if (rc_read != CANERR_NOERROR) {
+                health.OnResult(rc_read, now);
+            }
+            ServiceControllerHealth(*can_api, &control_mutex, health, bitrate, rx_ids,
+                                    sizeof(rx_ids) / sizeof(rx_ids[0]), now);
         }
+        rx_cpu = ThreadCpuTime();
     });
 
     std::thread tx_thread([&]() {
-        auto next_tick = std::chrono::steady_clock::now();
-        auto last_alive = std::chrono::steady_clock::now();
+        auto next_tick = clock.Now();
+        auto last_alive = clock.Now();
         while (g_running.load()) {
-            DoorStatus snapshot;
+            CANAPI_Message_t msg;
+            DoorState state;
             {
                 std::lock_guard<std::mutex> lock(status_mutex);
-                snapshot = status;
+                msg = door.StatusMessage();
+                state = door.Status().state;
             }
 
-            CANAPI_Message_t msg = BuildStatusMessage(config.door_id, snapshot);
-            CANAPI_Return_t rc_write = can_api.WriteMessage(msg, 0U);
+            CANAPI_Return_t rc_write;
+            {
+                std::lock_guard<std::mutex> lock(control_mutex);
+                rc_write = can_api->WriteMessage(msg);
+            }
             if (rc_write != CANERR_NOERROR) {
-                LogRateLimited(log_prefix, "CAN write error: " + ErrorToString(rc_write), write_limiter,
-                               std::chrono::milliseconds(1000));
+                LogRateLimited(log_prefix, write_limiter, std::chrono::milliseconds(1000),
+                               "CAN write error: %s (rc=%d)", ErrorToString(rc_write), rc_write);
+            }
+            {
+                std::lock_guard<std::mutex> lock(health_mutex);
+                if (rc_write == CANERR_NOERROR) {
+                    health.OnWriteAccepted(clock.Now());
+                } else {
+                    health.OnResult(rc_write, clock.Now());
+                }
             }
 
-            auto now = std::chrono::steady_clock::now();
+            auto now = clock.Now();
             if (now - last_alive >= std::chrono::seconds(1)) {
-                Log(log_prefix, "Alive: state=" + DoorStateToString(snapshot.state));
+                Log(log_prefix, "Alive: state=%s", DoorStateToString(state));
                 last_alive = now;
             }
 
             // Timing assumption: steady_clock + sleep_until keeps the TX period stable
             // within acceptable jitter for demo purposes.
             next_tick += std::chrono::milliseconds(config.period_ms);
-            std::this_thread::sleep_until(next_tick);
+            clock.SleepUntil(next_tick);
         }
     });
 
+    // Everything below this point is steady state; the tracking build fails on any allocation.
+    ArmAllocationTracking();
+
+    const auto started = clock.Now();
     while (g_running.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        clock.SleepFor(std::chrono::milliseconds(100));
+        if (config.duration_s > 0 && clock.Now() - started >= std::chrono::seconds(config.duration_s)) {
+            g_running = false;
+        }
     }
 
     Log(log_prefix, "Shutting down...");
+    motion_cv.notify_one();
 
     if (rx_thread.joinable()) {
         rx_thread.join();
@@ -409,10 +303,27 @@ int main(int argc, char **argv) {
     if (tx_thread.joinable()) {
         tx_thread.join();
     }
+    if (motion_thread.joinable()) {
+        motion_thread.join();
+    }
+
+    const AllocationStats allocations = AllocationsSinceArmed();
 
-    can_api.ResetController();
-    can_api.TeardownChannel();
+    LogCanStats(log_prefix, *can_api, rx_cpu);
+    LogControllerHealth(log_prefix, health);
+    can_api->ResetController();
+    can_api->TeardownChannel();
 
     Log(log_prefix, "Shutdown complete.");
+    if (kAllocationTrackingEnabled) {
+        if (allocations.count != 0) {
+            LogError(log_prefix, "%llu steady-state allocations (%llu bytes, largest %llu)",
+                     static_cast<unsigned long long>(allocations.count),
+                     static_cast<unsigned long long>(allocations.bytes),
+                     static_cast<unsigned long long>(allocations.largest));
+            return kExitAllocations;
+        }
+        Log(log_prefix, "Allocation check passed: no steady-state allocations.");
+    }
     return 0;
 }
@@ -0,0 +1,755 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AllocationTracker.h"
+#include "BusAnalysis.h"
+#include "Clock.h"
+#include "ControllerHealth.h"
+#include "DoorHistory.h"
+#include "DoorNodeLogic.h"
+#include "DoorProtocol.h"
+#include "DoorTable.h"
+#include "Logging.h"
+#include "RedundantMerge.h"
+#include "SimCanBus.h"
+
+// Discrete-event simulation of three DoorNodes and the HMI on one virtual CAN line, or on several
+// redundant ones. The door state machine (DoorNodeLogic), the HMI door table (DoorTable,
+// DoorHistory, BusMonitor), the line merge (RedundantMerge) and the controller health engine
+// (ControllerHealth) are the code the apps run; only the threads and sleeps are replaced by events
+// on SimScheduler, at the same periods the apps use.
+
+namespace {
+using namespace raildoor;
+
+constexpr int kExitScenarioFailed = 1;
+constexpr int kExitFailure = 2;
+constexpr int kExitAllocations = 3;
+constexpr size_t kRxBatch = 8;
+constexpr auto kDisplayPeriod = std::chrono::milliseconds(250);
+constexpr auto kStartupDelay = std::chrono::seconds(1);
+constexpr auto kIcdStatusPeriod = std::chrono::milliseconds(100);
+constexpr auto kCommandMinInterval = std::chrono::milliseconds(100);
+// The apps' rx loops service controller health after every batch and at least once per read
+// timeout.
+constexpr auto kHealthPeriod = std::chrono::milliseconds(100);
+constexpr double kTimingWarningRatio = 0.8;
+constexpr uint8_t kInjectedFaultCode = 7;
+const char *const kLineNames[kMaxCanLines] = {"sim0", "sim1", "sim2", "sim3"};
+
+struct Config {
+    int cycles = 1000;
+    std::string bitrate = "500k";
+    int period_ms = 100;
+    int move_ms = 2000;
+    int dwell_ms = 500;
+    int fault_every = 0;
+    int history_kib = 64;
+    int storm_every_s = 0;
+    int storm_ms = 200;
+    int storm_rate_hz = 5000;
+    int lines = 1;
+    int merge_window_ms = 20;
+    int cut_every_s = 0;
+    int cut_ms = 500;
+    int line_skew_us = 0;
+    int line_jitter_us = 0;
+    bool realtime = false;
+    bool verbose = false;
+};
+
+bool ParseArgs(int argc, char **argv, Config &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cycles" && i + 1 < argc) {
+            config.cycles = std::atoi(argv[++i]);
+        } else if (arg == "--bitrate" && i + 1 < argc) {
+            config.bitrate = argv[++i];
+        } else if (arg == "--period_ms" && i + 1 < argc) {
+            config.period_ms = std::atoi(argv[++i]);
+        } else if (arg == "--move_ms" && i + 1 < argc) {
+            config.move_ms = std::atoi(argv[++i]);
+        } else if (arg == "--dwell_ms" && i + 1 < argc) {
+            config.dwell_ms = std::atoi(argv[++i]);
+        } else if (arg == "--fault_every" && i + 1 < argc) {
+            config.fault_every = std::atoi(argv[++i]);
+        } else if (arg == "--history_kib" && i + 1 < argc) {
+            config.history_kib = std::atoi(argv[++i]);
+        } else if (arg == "--storm_every_s" && i + 1 < argc) {
+            config.storm_every_s = std::atoi(argv[++i]);
+        } else if (arg == "--storm_ms" && i + 1 < argc) {
+            config.storm_ms = std::atoi(argv[++i]);
+        } else if (arg == "--storm_rate_hz" && i + 1 < argc) {
+            config.storm_rate_hz = std::atoi(argv[++i]);
+        } else if (arg == "--lines" && i + 1 < argc) {
+            config.lines = std::atoi(argv[++i]);
+        } else if (arg == "--merge_window_ms" && i + 1 < argc) {
+            config.merge_window_ms = std::atoi(argv[++i]);
+        } else if (arg == "--cut_every_s" && i + 1 < argc) {
+            config.cut_every_s = std::atoi(argv[++i]);
+        } else if (arg == "--cut_ms" && i + 1 < argc) {
+            config.cut_ms = std::atoi(argv[++i]);
+        } else if (arg == "--line_skew_us" && i + 1 < argc) {
+            config.line_skew_us = std::atoi(argv[++i]);
+        } else if (arg == "--line_jitter_us" && i + 1 < argc) {
+            config.line_jitter_us = std::atoi(argv[++i]);
+        } else if (arg == "--realtime") {
+            config.realtime = true;
+        } else if (arg == "--verbose") {
+            config.verbose = true;
+        } else {
+            std::cerr << "Unknown or incomplete argument: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (config.cycles < 1) {
+        std::cerr << "--cycles must be >= 1" << std::endl;
+        return false;
+    }
+
+    if (config.period_ms <= 0 || config.move_ms <= 0 || config.dwell_ms < 0) {
+        std::cerr << "--period_ms and --move_ms must be > 0, --dwell_ms >= 0" << std::endl;
+        return false;
+    }
+
+    if (config.fault_every < 0) {
+        std::cerr << "--fault_every must be >= 0" << std::endl;
+        return false;
+    }
+
+    if (config.history_kib < 1 || config.history_kib > 4096) {
+        std::cerr << "--history_kib must be 1..4096" << std::endl;
+        return false;
+    }
+
+    if (config.storm_every_s < 0 || config.storm_ms <= 0 || config.storm_rate_hz <= 0) {
+        std::cerr << "--storm_every_s must be >= 0, --storm_ms and --storm_rate_hz > 0" << std::endl;
+        return false;
+    }
+
+    if (config.lines < 1 || config.lines > static_cast<int>(kMaxCanLines)) {
+        std::cerr << "--lines must be 1.." << kMaxCanLines << std::endl;
+        return false;
+    }
+
+    if (config.merge_window_ms < 1 || config.merge_window_ms > 50) {
+        std::cerr << "--merge_window_ms must be 1..50" << std::endl;
+        return false;
+    }
+
+    if (config.cut_every_s < 0 || config.cut_ms <= 0) {
+        std::cerr << "--cut_every_s must be >= 0, --cut_ms > 0" << std::endl;
+        return false;
+    }
+
+    // Copies further apart than the merge window are separate frames to the HMI.
+    if (config.line_skew_us < 0 || config.line_jitter_us < 0 ||
+        static_cast<int64_t>(config.line_skew_us) * (config.lines - 1) + config.line_jitter_us >=
+            static_cast<int64_t>(config.merge_window_ms) * 1000) {
+        std::cerr << "--line_skew_us and --line_jitter_us must be >= 0, and the largest skew between lines"
+                  << " must stay below --merge_window_ms" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PrintUsage() {
+    std::cout << "DoorSim.exe [--cycles 1000] [--bitrate 500k] [--period_ms 100] [--move_ms 2000] [--dwell_ms 500]"
+              << " [--fault_every 0] [--history_kib 64] [--storm_every_s 0] [--storm_ms 200]"
+              << " [--storm_rate_hz 5000] [--lines 1] [--merge_window_ms 20] [--cut_every_s 0] [--cut_ms 500]"
+              << " [--line_skew_us 0] [--line_jitter_us 0] [--realtime] [--verbose]" << std::endl;
+}
+
+uint32_t ToMs(std::chrono::steady_clock::duration duration) {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(duration).count());
+}
+
+void PrintDuration(const char *label, const DurationStats &stats) {
+    std::printf("  %-8s n=%llu mean=%u p50=%u p95=%u p99=%u max=%u ms\n", label,
+                static_cast<unsigned long long>(stats.count), stats.mean_ms, stats.p50_ms, stats.p95_ms,
+                stats.p99_ms, stats.max_ms);
+}
+
+void PrintDuration(const char *label, const DurationHistogram &histogram) {
+    PrintDuration(label, SummarizeDurations(histogram));
+}
+
+// "DoorNode[1]" on a single line, "DoorNode[1][sim0]" per line on redundant ones.
+void PortName(char *name, size_t size, const char *owner, size_t line, bool redundant) {
+    if (redundant) {
+        std::snprintf(name, size, "%s[%s]", owner, kLineNames[line]);
+    } else {
+        std::snprintf(name, size, "%s", owner);
+    }
+}
+
+void PrintHealth(const char *name, const ControllerHealth &health) {
+    const ControllerHealthSummary summary = health.Summarize();
+    std::printf("  %s: %s, %llu error frames, %llu storms, %llu bus-off, %llu passive, %llu restarts (%llu failed)\n",
+                name, ControllerStateToString(summary.state), static_cast<unsigned long long>(summary.error_frames),
+                static_cast<unsigned long long>(summary.storms),
+                static_cast<unsigned long long>(summary.bus_off_events),
+                static_cast<unsigned long long>(summary.passive_events),
+                static_cast<unsigned long long>(summary.restarts),
+                static_cast<unsigned long long>(summary.restart_failures));
+    if (summary.restarts > 0 || summary.outage.count > 0) {
+        PrintDuration("recovery", summary.recovery);
+        PrintDuration("outage", summary.outage);
+    }
+}
+
+bool StartBackend(const char *log_prefix, SimCanBackend &can, const char *channel, const CANAPI_Bitrate_t &bitrate,
+                  const uint32_t *rx_ids, size_t rx_id_count) {
+    CANAPI_Return_t rc = can.InitializeChannel(channel);
+    if (rc == CANERR_NOERROR) {
+        rc = can.StartController(bitrate);
+    }
+    if (rc == CANERR_NOERROR) {
+        rc = can.SetReceiveFilter(rx_ids, rx_id_count);
+    }
+    if (rc != CANERR_NOERROR) {
+        LogError(log_prefix, "Sim CAN start failed (rc=%d)", rc);
+        return false;
+    }
+    return true;
+}
+
+// A node's controller on one line, with its health engine.
+struct SimPort {
+    SimPort(SimCanBus &bus, SimScheduler &sim, const char *log_prefix) : can(bus, sim), health(log_prefix) {}
+
+    SimCanBackend can;
+    ControllerHealth health;
+};
+
+// One DoorNode: the app's rx thread, motion thread and tx thread become a receive handler, a
+// move-deadline event and a periodic status event, plus the rx loop's periodic health service.
+// On redundant lines the node has a port per line: it sends its status on every line and takes
+// commands from any, and a command that arrives twice finds the door already moving or done.
+struct SimDoorNode {
+    SimDoorNode(SimScheduler &sim, const std::vector<std::unique_ptr<SimCanBus>> &buses, const Config &config,
+                int door_id, const CANAPI_Bitrate_t &can_bitrate)
+        : scheduler(sim),
+          logic(log_prefix, door_id, std::chrono::milliseconds(config.move_ms), 0),
+          bitrate(can_bitrate),
+          period(config.period_ms) {
+        std::snprintf(log_prefix, sizeof(log_prefix), "DoorNode[%d]", door_id);
+        for (const std::unique_ptr<SimCanBus> &bus : buses) {
+            ports.push_back(std::make_unique<SimPort>(*bus, sim, log_prefix));
+        }
+    }
+
+    void Start(std::chrono::steady_clock::time_point first_tick) {
+        for (const std::unique_ptr<SimPort> &port : ports) {
+            SimPort *const receiver = port.get();
+            port->can.SetReceiveHandler([this, receiver]() { OnReceive(*receiver); });
+        }
+        next_tick = first_tick;
+        scheduler.At(next_tick, [this]() { OnTxTick(); });
+        scheduler.At(first_tick, [this]() { OnHealthTick(); });
+    }
+
+    void OnReceive(SimPort &port) {
+        std::array<CANAPI_Message_t, kRxBatch> batch{};
+        size_t count = 0;
+        while (port.can.ReadMessages(batch.data(), batch.size(), count, 0) == CANERR_NOERROR) {
+            for (size_t i = 0; i < count; ++i) {
+                if (batch[i].sts != 0) {
+                    port.health.OnErrorFrame(scheduler.Now());
+                    continue;
+                }
+                port.health.OnTraffic(scheduler.Now());
+                if (logic.OnFrame(batch[i], scheduler.Now())) {
+                    scheduler.At(logic.MoveDeadline(), [this]() { logic.Poll(scheduler.Now()); });
+                }
+            }
+        }
+        ServiceControllerHealth(port.can, nullptr, port.health, bitrate, rx_ids.data(), rx_ids.size(), scheduler.Now());
+    }
+
+    void OnTxTick() {
+        const CANAPI_Message_t message = logic.StatusMessage();
+        for (const std::unique_ptr<SimPort> &port : ports) {
+            const CANAPI_Return_t rc = port->can.WriteMessage(message);
+            if (rc == CANERR_NOERROR) {
+                port->health.OnWriteAccepted(scheduler.Now());
+            } else {
+                port->health.OnResult(rc, scheduler.Now());
+            }
+        }
+        next_tick += period;
+        scheduler.At(next_tick, [this]() { OnTxTick(); });
+    }
+
+    void OnHealthTick() {
+        for (const std::unique_ptr<SimPort> &port : ports) {
+            ServiceControllerHealth(port->can, nullptr, port->health, bitrate, rx_ids.data(), rx_ids.size(),
+                                    scheduler.Now());
+        }
+        scheduler.After(kHealthPeriod, [this]() { OnHealthTick(); });
+    }
+
+    char log_prefix[32];
+    SimScheduler &scheduler;
+    std::vector<std::unique_ptr<SimPort>> ports;
+    DoorNodeLogic logic;
+    CANAPI_Bitrate_t bitrate;
+    std::array<uint32_t, 1> rx_ids{{kCommandId}};
+    std::chrono::milliseconds period;
+    std::chrono::steady_clock::time_point next_tick{};
+};
+
+enum class Step : uint8_t {
+    Open,
+    Close,
+    Fault,
+    Reset
+};
+
+// Operator script for one door: open, dwell, close, dwell, repeated, with an injected fault and
+// reset every fault_every cycles. Each step waits until the HMI table shows the expected state.
+struct DoorScript {
+    Step step = Step::Open;
+    DoorState expect = DoorState::Open;
+    bool waiting = false;
+    uint64_t attempt = 0;
+    std::chrono::steady_clock::time_point started{};
+    int cycles_done = 0;
+    DoorState last_seen = DoorState::Closed;
+    uint8_t last_fault = 0;
+};
+
+struct ScenarioResult {
+    DurationHistogram latency[4];
+    uint64_t timeouts = 0;
+    uint64_t stale_observations = 0;
+    uint64_t hmi_transitions = 0;
+    uint64_t storms = 0;
+    uint64_t cuts = 0;
+    DurationHistogram failover;        // cut to line DOWN
+    DurationHistogram failover_frame;  // first lost frame to line DOWN
+    std::array<uint32_t, kDoorCount> max_status_gap_ms{};
+    std::chrono::nanoseconds merge_time{0};
+    uint64_t merge_calls = 0;
+    uint64_t digest = 14695981039346656037ULL;
+    BusReport bus{};
+    int doors_done = 0;
+};
+
+void Mix(uint64_t &digest, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        digest ^= (value >> (8 * i)) & 0xFFU;
+        digest *= 1099511628211ULL;
+    }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    Config config;
+    if (!ParseArgs(argc, argv, config)) {
+        PrintUsage();
+        return kExitFailure;
+    }
+    const char *const log_prefix = "DoorSim";
+    g_log_muted = !config.verbose;
+
+    SimScheduler scheduler(config.realtime);
+    const auto origin = scheduler.Now();
+
+    CANAPI_Bitrate_t bitrate{};
+    uint32_t bits_per_second = 0;
+    if (!SimCanBackend::LookupBitrate(config.bitrate, bitrate, bits_per_second)) {
+        LogError(log_prefix, "Invalid bitrate string: %s", config.bitrate.c_str());
+        return kExitFailure;
+    }
+    const size_t line_count = static_cast<size_t>(config.lines);
+    const bool redundant = line_count > 1;
+    std::vector<std::unique_ptr<SimCanBus>> buses;
+    for (size_t line = 0; line < line_count; ++line) {
+        buses.push_back(std::make_unique<SimCanBus>(scheduler, bits_per_second));
+        // Line N lags line 0 by N skews on average; the jitter lets either line be first.
+        buses[line]->SetDeliveryLatency(std::chrono::microseconds(config.line_skew_us * static_cast<int>(line)),
+                                        std::chrono::microseconds(config.line_jitter_us), line + 1U);
+    }
+
+    std::array<std::unique_ptr<SimDoorNode>, kDoorCount> nodes;
+    for (size_t i = 0; i < kDoorCount; ++i) {
+        nodes[i] = std::make_unique<SimDoorNode>(scheduler, buses, config, static_cast<int>(i + 1), bitrate);
+        for (size_t line = 0; line < line_count; ++line) {
+            if (!StartBackend(nodes[i]->log_prefix, nodes[i]->ports[line]->can, kLineNames[line], bitrate,
+                              nodes[i]->rx_ids.data(), nodes[i]->rx_ids.size())) {
+                return kExitFailure;
+            }
+        }
+        // Nodes power up a few milliseconds apart, as they would on the train.
+        nodes[i]->Start(origin + std::chrono::milliseconds(7 * static_cast<int>(i)));
+    }
+
+    const char *const hmi_prefix = "HmiApp";
+    const uint32_t hmi_rx_ids[] = {kStatusIdBase, kStatusIdBase + 1U, kStatusIdMax};
+    std::vector<std::unique_ptr<SimPort>> hmi_ports;
+    for (size_t line = 0; line < line_count; ++line) {
+        hmi_ports.push_back(std::make_unique<SimPort>(*buses[line], scheduler, hmi_prefix));
+        if (!StartBackend(hmi_prefix, hmi_ports[line]->can, kLineNames[line], bitrate, hmi_rx_ids, 3)) {
+            return kExitFailure;
+        }
+    }
+    RedundantMerge merge(hmi_prefix, kLineNames, line_count, std::chrono::milliseconds(config.merge_window_ms));
+    // The display reports line 0, as the HmiApp console does for a single line.
+    DoorTable door_table(hmi_prefix, static_cast<size_t>(config.history_kib) * 1024U);
+    BusMonitor bus_monitor(hmi_prefix, bits_per_second, kTimingWarningRatio);
+    for (uint32_t id = kStatusIdBase; id <= kStatusIdMax; ++id) {
+        bus_monitor.AddMessage(id, 8, kIcdStatusPeriod, false);
+    }
+    bus_monitor.AddMessage(kCommandId, 8, kCommandMinInterval, true);
+
+    ScenarioResult result;
+    std::array<DoorScript, kDoorCount> scripts{};
+    const auto dwell = std::chrono::milliseconds(config.dwell_ms);
+    const auto step_timeout = std::chrono::milliseconds(config.move_ms + 1000);
+
+    std::function<void(size_t, Step)> issue;
+    issue = [&](size_t index, Step step) {
+        DoorScript &script = scripts[index];
+        script.step = step;
+        script.waiting = true;
+        script.started = scheduler.Now();
+        const uint64_t attempt = ++script.attempt;
+        const uint8_t door_id = static_cast<uint8_t>(index + 1);
+        if (step == Step::Fault) {
+            script.expect = DoorState::Faulted;
+            nodes[index]->logic.InjectFault(kInjectedFaultCode);
+        } else {
+            uint8_t cmd = kCommandOpen;
+            script.expect = DoorState::Open;
+            if (step == Step::Close) {
+                cmd = kCommandClose;
+                script.expect = DoorState::Closed;
+            } else if (step == Step::Reset) {
+                cmd = kCommandResetFault;
+                script.expect = DoorState::Closed;
+            }
+            const CANAPI_Message_t message = BuildCommandMessage(door_id, cmd);
+            for (size_t line = 0; line < line_count; ++line) {
+                SimPort &port = *hmi_ports[line];
+                const CANAPI_Return_t rc = port.can.WriteMessage(message);
+                if (rc == CANERR_NOERROR) {
+                    port.health.OnWriteAccepted(scheduler.Now());
+                    if (line == 0) {
+                        bus_monitor.OnFrame(message, scheduler.Now());
+                    }
+                } else {
+                    port.health.OnResult(rc, scheduler.Now());
+                }
+            }
+        }
+        scheduler.After(step_timeout, [&, index, step, attempt]() {
+            if (scripts[index].waiting && scripts[index].attempt == attempt) {
+                ++result.timeouts;
+                LogError(log_prefix, "Door %zu: no %s at the HMI %u ms after the step, retrying", index + 1,
+                         DoorStateToString(scripts[index].expect), ToMs(step_timeout));
+                issue(index, step);
+            }
+        });
+    };
+
+    auto on_door_update = [&](size_t index) {
+        const DoorInfo &info = door_table.Doors()[index];
+        DoorScript &script = scripts[index];
+        if (info.state != script.last_seen || info.fault_code != script.last_fault) {
+            script.last_seen = info.state;
+            script.last_fault = info.fault_code;
+            ++result.hmi_transitions;
+            Mix(result.digest, index);
+            Mix(result.digest, static_cast<uint64_t>(info.state));
+            Mix(result.digest, info.fault_code);
+            Mix(result.digest, static_cast<uint64_t>((info.last_update - origin).count()));
+        }
+        if (!script.waiting || info.state != script.expect) {
+            return;
+        }
+        script.waiting = false;
+        result.latency[static_cast<size_t>(script.step)].Add(ToMs(scheduler.Now() - script.started));
+
+        Step next = Step::Open;
+        switch (script.step) {
+            case Step::Open:
+                next = (config.fault_every > 0 && (script.cycles_done + 1) % config.fault_every == 0) ? Step::Fault
+                                                                                                    : Step::Close;
+                break;
+            case Step::Fault:
+                next = Step::Reset;
+                break;
+            case Step::Close:
+            case Step::Reset:
+                if (++script.cycles_done == config.cycles) {
+                    if (++result.doors_done == static_cast<int>(kDoorCount)) {
+                        scheduler.Stop();
+                    }
+                    return;
+                }
+                next = Step::Open;
+                break;
+        }
+        scheduler.After(dwell, [&, index, next]() { issue(index, next); });
+    };
+
+    // Cut bookkeeping for the failover measurement: line 0 is the one that gets cut.
+    std::chrono::steady_clock::time_point cut_started{};
+    bool cut_pending = false;
+    uint64_t down_events_seen = 0;
+    auto check_failover = [&]() {
+        const LineStats &line0 = merge.Line(0);
+        if (line0.down_events == down_events_seen) {
+            return;
+        }
+        down_events_seen = line0.down_events;
+        if (cut_pending) {
+            cut_pending = false;
+            result.failover.Add(ToMs(line0.last_down - cut_started));
+            result.failover_frame.Add(ToMs(line0.last_down - line0.last_missed));
+        }
+    };
+
+    std::array<std::chrono::steady_clock::time_point, kDoorCount> last_status{};
+    auto on_status = [&](size_t line, const CANAPI_Message_t &message, std::chrono::steady_clock::time_point rx_time) {
+        if (redundant) {
+            const auto merge_start = std::chrono::steady_clock::now();
+            const bool fresh = merge.OnFrame(line, message, rx_time);
+            result.merge_time += std::chrono::steady_clock::now() - merge_start;
+            ++result.merge_calls;
+            check_failover();
+            if (!fresh) {
+                return;
+            }
+        }
+        const uint8_t door_id = door_table.OnStatusFrame(message, rx_time);
+        if (door_id == 0) {
+            return;
+        }
+        const size_t index = door_id - 1U;
+        if (rx_time - origin > kStartupDelay) {
+            const uint32_t gap = ToMs(rx_time - last_status[index]);
+            if (gap > result.max_status_gap_ms[index]) {
+                result.max_status_gap_ms[index] = gap;
+            }
+        }
+        last_status[index] = rx_time;
+        on_door_update(index);
+    };
+
+    for (size_t line = 0; line < line_count; ++line) {
+        SimPort &port = *hmi_ports[line];
+        port.can.SetReceiveHandler([&, line]() {
+            std::array<CANAPI_Message_t, kRxBatch> batch{};
+            size_t count = 0;
+            while (port.can.ReadMessages(batch.data(), batch.size(), count, 0) == CANERR_NOERROR) {
+                for (size_t i = 0; i < count; ++i) {
+                    const auto rx_time = port.can.ReceiveTime(batch[i]);
+                    if (batch[i].sts != 0) {
+                        port.health.OnErrorFrame(rx_time);
+                        continue;
+                    }
+                    port.health.OnTraffic(rx_time);
+                    if (line == 0) {
+                        bus_monitor.OnFrame(batch[i], rx_time);
+                    }
+                    on_status(line, batch[i], rx_time);
+                }
+            }
+            ServiceControllerHealth(port.can, nullptr, port.health, bitrate, hmi_rx_ids, 3, scheduler.Now());
+        });
+    }
+
+    std::function<void()> hmi_health_tick;
+    hmi_health_tick = [&]() {
+        for (const std::unique_ptr<SimPort> &port : hmi_ports) {
+            ServiceControllerHealth(port->can, nullptr, port->health, bitrate, hmi_rx_ids, 3, scheduler.Now());
+        }
+        scheduler.After(kHealthPeriod, hmi_health_tick);
+    };
+    scheduler.After(kHealthPeriod, hmi_health_tick);
+
+    // The redundant rx workers' read timeout: the merge is polled once per window.
+    const auto merge_window = std::chrono::milliseconds(config.merge_window_ms);
+    std::function<void()> merge_tick;
+    merge_tick = [&]() {
+        const auto merge_start = std::chrono::steady_clock::now();
+        merge.Poll(scheduler.Now());
+        result.merge_time += std::chrono::steady_clock::now() - merge_start;
+        ++result.merge_calls;
+        check_failover();
+        scheduler.After(merge_window, merge_tick);
+    };
+    if (redundant) {
+        scheduler.After(merge_window, merge_tick);
+    }
+
+    // Fault injection: line 0 is cut for cut_ms every cut_every_s, from the first command onwards.
+    // Each cut comes 13 ms later in the status period than the one before, so the cuts sample
+    // every phase of the doors' traffic.
+    const auto cut_every = std::chrono::seconds(config.cut_every_s) + std::chrono::milliseconds(13);
+    std::function<void()> cut;
+    cut = [&]() {
+        ++result.cuts;
+        buses[0]->StartCut(std::chrono::milliseconds(config.cut_ms));
+        cut_started = scheduler.Now();
+        cut_pending = true;
+        scheduler.After(cut_every, cut);
+    };
+    if (config.cut_every_s > 0) {
+        scheduler.At(origin + kStartupDelay + cut_every, cut);
+    }
+
+    // Fault injection: an error storm every storm_every_s, from the first command onwards.
+    const auto storm_every = std::chrono::seconds(config.storm_every_s);
+    std::function<void()> storm;
+    storm = [&]() {
+        ++result.storms;
+        buses[0]->StartErrorStorm(std::chrono::milliseconds(config.storm_ms), static_cast<double>(config.storm_rate_hz));
+        scheduler.After(storm_every, storm);
+    };
+    if (config.storm_every_s > 0) {
+        scheduler.At(origin + kStartupDelay + storm_every, storm);
+    }
+
+    // The display thread's refresh: staleness as the operator would see it, and the bus line.
+    std::function<void()> refresh;
+    refresh = [&]() {
+        const auto now = scheduler.Now();
+        if (now - origin > kStartupDelay) {
+            for (const DoorInfo &info : door_table.Doors()) {
+                if (IsStale(info, now)) {
+                    ++result.stale_observations;
+                }
+            }
+        }
+        result.bus = bus_monitor.Refresh(now);
+        scheduler.After(kDisplayPeriod, refresh);
+    };
+    scheduler.After(kDisplayPeriod, refresh);
+
+    for (size_t i = 0; i < kDoorCount; ++i) {
+        // Operators do not press all buttons in the same millisecond either.
+        scheduler.At(origin + kStartupDelay + std::chrono::milliseconds(333 * static_cast<int>(i)),
+                     [&, i]() { issue(i, Step::Open); });
+    }
+
+    // Generous bound in case a step never completes: every cycle at twice its nominal length.
+    const auto nominal_cycle = 2 * (std::chrono::milliseconds(config.move_ms) + dwell + step_timeout);
+    const auto limit = origin + kStartupDelay + nominal_cycle * 2 * config.cycles;
+    // Allocation-tracked builds count everything the apps' logic allocates once the doors are up,
+    // as the apps do once their threads run; the event queue itself is exempt (see SimScheduler).
+    scheduler.At(origin + kStartupDelay, []() { ArmAllocationTracking(); });
+    const auto wall_start = std::chrono::steady_clock::now();
+    scheduler.RunUntil(limit);
+    const auto wall = std::chrono::steady_clock::now() - wall_start;
+    const AllocationStats allocations = AllocationsSinceArmed();
+    const auto simulated = scheduler.Now() - origin;
+
+    g_log_muted = false;
+    const int total_cycles = config.cycles * static_cast<int>(kDoorCount);
+    int completed = 0;
+    for (const DoorScript &script : scripts) {
+        completed += script.cycles_done;
+    }
+    const double wall_s = std::chrono::duration<double>(wall).count();
+    const double simulated_s = std::chrono::duration<double>(simulated).count();
+    std::printf("%d/%d door cycles (%d per door), %llu timeouts, %llu stale observations\n", completed, total_cycles,
+                config.cycles, static_cast<unsigned long long>(result.timeouts),
+                static_cast<unsigned long long>(result.stale_observations));
+    std::printf("  %.1f s simulated in %.1f ms wall (%.0fx), %llu events, %llu frames, bus %.1f%% busy\n",
+                simulated_s, wall_s * 1000.0, wall_s > 0.0 ? simulated_s / wall_s : 0.0,
+                static_cast<unsigned long long>(scheduler.ExecutedEvents()),
+                static_cast<unsigned long long>(buses[0]->FramesTransmitted()),
+                simulated_s > 0.0 ? 100.0 * std::chrono::duration<double>(buses[0]->BusyTime()).count() / simulated_s
+                                  : 0.0);
+    std::printf("  Command to state seen at the HMI:\n");
+    PrintDuration("open", result.latency[static_cast<size_t>(Step::Open)]);
+    PrintDuration("close", result.latency[static_cast<size_t>(Step::Close)]);
+    PrintDuration("fault", result.latency[static_cast<size_t>(Step::Fault)]);
+    PrintDuration("reset", result.latency[static_cast<size_t>(Step::Reset)]);
+    for (size_t i = 0; i < kDoorCount; ++i) {
+        const DoorHistorySummary summary = door_table.History(i).Summarize(scheduler.Now());
+        std::printf("  Door %zu history: %llu cycles, %llu fault episodes, cycle p95=%u ms\n", i + 1,
+                    static_cast<unsigned long long>(summary.cycles),
+                    static_cast<unsigned long long>(summary.fault_episodes), summary.cycle.p95_ms);
+    }
+    std::printf("  Bus analysis: U=%.1f%%, worst 0x%03X R=%.2f/%.0f ms %s\n", result.bus.analysed_utilisation_pct,
+                static_cast<unsigned>(result.bus.worst_id), result.bus.worst_response_ms,
+                result.bus.worst_deadline_ms, TimingVerdictToString(result.bus.worst_verdict));
+    if (config.storm_every_s > 0) {
+        std::printf("  Error storms: %llu x %d ms at %d errors/s, %llu frames destroyed\n",
+                    static_cast<unsigned long long>(result.storms), config.storm_ms, config.storm_rate_hz,
+                    static_cast<unsigned long long>(buses[0]->FramesDestroyed()));
+        for (size_t line = 0; line < line_count; ++line) {
+            char name[48];
+            for (const auto &node : nodes) {
+                PortName(name, sizeof(name), node->log_prefix, line, redundant);
+                PrintHealth(name, node->ports[line]->health);
+            }
+            PortName(name, sizeof(name), hmi_prefix, line, redundant);
+            PrintHealth(name, hmi_ports[line]->health);
+        }
+    }
+    if (redundant || config.cut_every_s > 0) {
+        std::printf("  Lines: %zu, merge window %d ms, skew %d us, jitter %d us, %llu cuts x %d ms on sim0,"
+                    " %llu frames lost\n",
+                    line_count, config.merge_window_ms, config.line_skew_us, config.line_jitter_us,
+                    static_cast<unsigned long long>(result.cuts), config.cut_ms,
+                    static_cast<unsigned long long>(buses[0]->FramesLost()));
+        for (size_t line = 0; line < merge.LineCount() && redundant; ++line) {
+            const LineStats &stats = merge.Line(line);
+            std::printf("  %s: %s, %llu frames, %llu first, %llu duplicate, %llu missed, %llu down events\n",
+                        kLineNames[line], LineStateToString(stats.state), static_cast<unsigned long long>(stats.frames),
+                        static_cast<unsigned long long>(stats.first_copies),
+                        static_cast<unsigned long long>(stats.duplicates),
+                        static_cast<unsigned long long>(stats.missed),
+                        static_cast<unsigned long long>(stats.down_events));
+        }
+        if (redundant) {
+            std::printf("  Merge: %llu calls, %.0f ns per call (wall, including the clock reads)\n",
+                        static_cast<unsigned long long>(result.merge_calls),
+                        result.merge_calls > 0 ? static_cast<double>(result.merge_time.count()) /
+                                                     static_cast<double>(result.merge_calls)
+                                               : 0.0);
+        }
+        if (result.failover.Count() > 0) {
+            PrintDuration("failover", result.failover);
+            PrintDuration("detect", result.failover_frame);
+        }
+        std::printf("  Max status gap at the HMI: %u / %u / %u ms\n", result.max_status_gap_ms[0],
+                    result.max_status_gap_ms[1], result.max_status_gap_ms[2]);
+    }
+    std::printf("  Result digest %016llx over %llu HMI transitions\n", static_cast<unsigned long long>(result.digest),
+                static_cast<unsigned long long>(result.hmi_transitions));
+
+    // Storms, and cuts without a second line, are meant to cost timeouts and stale doors; every cycle
+    // must still complete. A cut with a second line must cost nothing.
+    const bool lossy = config.storm_every_s > 0 || (config.cut_every_s > 0 && !redundant);
+    if (completed != total_cycles || (!lossy && (result.timeouts != 0 || result.stale_observations != 0))) {
+        LogError(log_prefix, "Scenario failed");
+        return kExitScenarioFailed;
+    }
+    Log(log_prefix, "Scenario passed");
+    if (kAllocationTrackingEnabled) {
+        if (allocations.count != 0) {
+            LogError(log_prefix, "%llu steady-state allocations (%llu bytes, largest %llu)",
+                     static_cast<unsigned long long>(allocations.count),
+                     static_cast<unsigned long long>(allocations.bytes),
+                     static_cast<unsigned long long>(allocations.largest));
+            return kExitAllocations;
+        }
+        Log(log_prefix, "Allocation check passed: no steady-state allocations.");
+    }
+    return 0;
+}
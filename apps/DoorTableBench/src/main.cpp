@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "DoorProtocol.h"
+#include "Logging.h"
+#include "SharedDoorTable.h"
+
+// Benchmark and example reader for the shared-memory door table (SharedDoorTable.h).
+//   default   publishes into a private segment and measures writer cost and publish-to-read latency
+//   --watch   attaches to HmiApp's segment and prints door changes as they are published
+
+namespace {
+using namespace raildoor;
+
+constexpr int kExitFailure = 2;
+constexpr const char *kBenchSegmentName = "raildoor_doortable_bench";
+
+enum class ReaderMode : uint8_t {
+    None,
+    Poll,
+    Wait
+};
+
+struct Config {
+    bool watch = false;
+    std::string shm_name;
+    int readers = 2;
+    int rate_hz = 1000;
+    int duration_s = 2;
+    int publishes = 1000000;
+    int poll_us = 0;
+};
+
+std::atomic<bool> g_running{true};
+
+#ifdef _WIN32
+BOOL WINAPI ConsoleHandler(DWORD type) {
+    if (type == CTRL_C_EVENT || type == CTRL_CLOSE_EVENT || type == CTRL_BREAK_EVENT) {
+        g_running = false;
+        return TRUE;
+    }
+    return FALSE;
+}
+#else
+void SignalHandler(int) {
+    g_running = false;
+}
+#endif
+
+bool ParseArgs(int argc, char **argv, Config &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--watch") {
+            config.watch = true;
+        } else if (arg == "--shm_name" && i + 1 < argc) {
+            config.shm_name = argv[++i];
+        } else if (arg == "--readers" && i + 1 < argc) {
+            config.readers = std::atoi(argv[++i]);
+        } else if (arg == "--rate_hz" && i + 1 < argc) {
+            config.rate_hz = std::atoi(argv[++i]);
+        } else if (arg == "--duration_s" && i + 1 < argc) {
+            config.duration_s = std::atoi(argv[++i]);
+        } else if (arg == "--publishes" && i + 1 < argc) {
+            config.publishes = std::atoi(argv[++i]);
+        } else if (arg == "--poll_us" && i + 1 < argc) {
+            config.poll_us = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown or incomplete argument: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    if (config.shm_name.empty()) {
+        config.shm_name = config.watch ? kDefaultSharedDoorTableName : kBenchSegmentName;
+    }
+
+    if (config.readers < 1 || config.readers > 64) {
+        std::cerr << "--readers must be 1..64" << std::endl;
+        return false;
+    }
+
+    if (config.rate_hz < 1 || config.rate_hz > 100000 || config.publishes < 1 || config.poll_us < 0) {
+        std::cerr << "--rate_hz must be 1..100000, --publishes >= 1, --poll_us >= 0" << std::endl;
+        return false;
+    }
+
+    if (config.duration_s < 0 || (!config.watch && config.duration_s == 0)) {
+        std::cerr << "--duration_s must be >= 0 (> 0 for the benchmark)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void PrintUsage() {
+    std::cout << "DoorTableBench.exe [--readers 2] [--rate_hz 1000] [--duration_s 2] [--publishes 1000000]"
+              << " [--poll_us 0] [--shm_name raildoor_doortable_bench]\n"
+              << "DoorTableBench.exe --watch [--shm_name raildoor_doortable] [--duration_s 0]" << std::endl;
+}
+
+double ToUs(int64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+int64_t ElapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+const char *ReaderModeToString(ReaderMode mode) {
+    switch (mode) {
+        case ReaderMode::None:
+            return "no readers";
+        case ReaderMode::Poll:
+            return "polling";
+        case ReaderMode::Wait:
+            return "futex-waiting";
+        default:
+            return "unknown";
+    }
+}
+
+// A reader thread with its own mapping, as a separate process would have. Records the age of
+// every published record it observes, measured from the writer's publish timestamp.
+class BenchReader {
+public:
+    BenchReader(const Config &config, ReaderMode mode, size_t expected_samples)
+        : config_(config), mode_(mode) {
+        samples_.reserve(expected_samples);
+    }
+
+    bool Open() {
+        const SharedTableStatus status = reader_.Open(config_.shm_name);
+        if (status != SharedTableStatus::Ok) {
+            LogError("DoorTableBench", "Reader open failed: %s", SharedTableStatusToString(status));
+            return false;
+        }
+        return true;
+    }
+
+    void Run(const std::atomic<bool> &stop) {
+        uint32_t seen = reader_.ChangeCount();
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (mode_ == ReaderMode::Wait) {
+                if (!reader_.WaitForChange(seen, std::chrono::milliseconds(100))) {
+                    continue;
+                }
+            } else {
+                const uint32_t current = reader_.ChangeCount();
+                if (current == seen) {
+                    if (config_.poll_us > 0) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(config_.poll_us));
+                    } else {
+                        std::this_thread::yield();
+                    }
+                    continue;
+                }
+                seen = current;
+            }
+            const auto observed = std::chrono::steady_clock::now();
+            for (size_t door = 0; door < kDoorCount; ++door) {
+                SharedDoorSnapshot snapshot;
+                if (!reader_.Read(door, snapshot)) {
+                    continue;
+                }
+                ++reads_;
+                if (snapshot.updates != last_updates_[door]) {
+                    last_updates_[door] = snapshot.updates;
+                    if (samples_.size() < samples_.capacity()) {
+                        samples_.push_back(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(observed - snapshot.published).count());
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<int64_t> &Samples() {
+        return samples_;
+    }
+
+    uint64_t Reads() const {
+        return reads_;
+    }
+
+private:
+    const Config &config_;
+    ReaderMode mode_;
+    SharedDoorTableReader reader_;
+    std::vector<int64_t> samples_;
+    uint64_t last_updates_[kDoorCount] = {};
+    uint64_t reads_ = 0;
+};
+
+struct ReaderPool {
+    ReaderPool(const Config &config, ReaderMode mode, size_t expected_samples) {
+        if (mode == ReaderMode::None) {
+            return;
+        }
+        for (int i = 0; i < config.readers; ++i) {
+            readers.emplace_back(new BenchReader(config, mode, expected_samples));
+            if (!readers.back()->Open()) {
+                ok = false;
+                return;
+            }
+        }
+        for (auto &reader : readers) {
+            BenchReader *raw = reader.get();
+            threads.emplace_back([this, raw]() { raw->Run(stop); });
+        }
+        // Let waiting readers reach the futex before the writer starts.
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    ~ReaderPool() {
+        Join();
+    }
+
+    void Join() {
+        stop = true;
+        for (std::thread &thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<BenchReader>> readers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> stop{false};
+    bool ok = true;
+};
+
+// Writer cost per Publish + Notify, back to back, as the rx thread would pay it.
+bool MeasurePublishCost(const Config &config, SharedDoorTableWriter &writer, ReaderMode mode) {
+    ReaderPool pool(config, mode, 0);
+    if (!pool.ok) {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const auto last_update = start;
+    for (int i = 0; i < config.publishes; ++i) {
+        writer.Publish(static_cast<size_t>(i) % kDoorCount, DoorState::Moving, 0, 0, last_update);
+        writer.Notify();
+    }
+    const int64_t elapsed = ElapsedNs(start);
+    pool.Join();
+    uint64_t reads = 0;
+    for (const auto &reader : pool.readers) {
+        reads += reader->Reads();
+    }
+    std::printf("  publish+notify, %-13s %7.1f ns/update  (%d readers, %llu reads)\n", ReaderModeToString(mode),
+                static_cast<double>(elapsed) / config.publishes, mode == ReaderMode::None ? 0 : config.readers,
+                static_cast<unsigned long long>(reads));
+    return true;
+}
+
+// Publish-to-observe latency with the writer paced like the HmiApp rx thread.
+bool MeasureLatency(const Config &config, SharedDoorTableWriter &writer, ReaderMode mode) {
+    const size_t expected = static_cast<size_t>(config.rate_hz) * static_cast<size_t>(config.duration_s) + 16U;
+    ReaderPool pool(config, mode, expected);
+    if (!pool.ok) {
+        return false;
+    }
+    const auto period = std::chrono::nanoseconds(1000000000LL / config.rate_hz);
+    const auto start = std::chrono::steady_clock::now();
+    auto next = start;
+    size_t published = 0;
+    int64_t writer_ns = 0;
+    while (g_running.load() && std::chrono::steady_clock::now() - start < std::chrono::seconds(config.duration_s)) {
+        const auto before = std::chrono::steady_clock::now();
+        writer.Publish(published % kDoorCount, DoorState::Open, 0, 0, before);
+        writer.Notify();
+        writer_ns += ElapsedNs(before);
+        ++published;
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+    // Give the last wake-up time to land before stopping the readers.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pool.Join();
+
+    std::vector<int64_t> all;
+    for (const auto &reader : pool.readers) {
+        all.insert(all.end(), reader->Samples().begin(), reader->Samples().end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) {
+        return all.empty() ? 0 : all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))];
+    };
+    std::printf("  %-13s %zu publishes, %zu observed: p50=%.1f p90=%.1f p99=%.1f max=%.1f us;"
+                " writer %.0f ns/update\n",
+                ReaderModeToString(mode), published, all.size(), ToUs(percentile(0.50)), ToUs(percentile(0.90)),
+                ToUs(percentile(0.99)), ToUs(all.empty() ? 0 : all.back()),
+                published ? static_cast<double>(writer_ns) / static_cast<double>(published) : 0.0);
+    return true;
+}
+
+// Reader-side cost of one consistent snapshot with no writer activity.
+void MeasureReadCost(const Config &config) {
+    SharedDoorTableReader reader;
+    if (reader.Open(config.shm_name) != SharedTableStatus::Ok) {
+        return;
+    }
+    constexpr int kReads = 1000000;
+    uint64_t checksum = 0;
+    SharedDoorSnapshot snapshot;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kReads; ++i) {
+        reader.Read(static_cast<size_t>(i) % kDoorCount, snapshot);
+        checksum += snapshot.updates;
+    }
+    const int64_t elapsed = ElapsedNs(start);
+    std::printf("  read snapshot               %7.1f ns/read (checksum %llu)\n",
+                static_cast<double>(elapsed) / kReads, static_cast<unsigned long long>(checksum % 10U));
+}
+
+int RunBenchmark(const Config &config) {
+    SharedDoorTableWriter writer;
+    const SharedTableStatus status = writer.Create(config.shm_name);
+    if (status != SharedTableStatus::Ok) {
+        LogError("DoorTableBench", "Cannot create \"%s\": %s", config.shm_name.c_str(),
+                 SharedTableStatusToString(status));
+        return kExitFailure;
+    }
+    std::printf("Segment \"%s\": %zu bytes, %zu doors, %d reader threads, %u hardware threads\n",
+                config.shm_name.c_str(), sizeof(SharedDoorTableLayout), kDoorCount, config.readers,
+                std::thread::hardware_concurrency());
+
+    std::printf("Writer cost (%d back-to-back updates):\n", config.publishes);
+    for (ReaderMode mode : {ReaderMode::None, ReaderMode::Poll, ReaderMode::Wait}) {
+        if (!MeasurePublishCost(config, writer, mode)) {
+            return kExitFailure;
+        }
+    }
+    MeasureReadCost(config);
+
+    std::printf("Publish-to-read latency (writer at %d Hz for %d s):\n", config.rate_hz, config.duration_s);
+    for (ReaderMode mode : {ReaderMode::Poll, ReaderMode::Wait}) {
+        if (!MeasureLatency(config, writer, mode)) {
+            return kExitFailure;
+        }
+    }
+    return 0;
+}
+
+// Example dashboard: waits for HmiApp to publish and prints each door whose record changed.
+int RunWatch(const Config &config) {
+    const char *const log_prefix = "DoorTableBench";
+    SharedDoorTableReader reader;
+    const SharedTableStatus status = reader.Open(config.shm_name);
+    if (status != SharedTableStatus::Ok) {
+        LogError(log_prefix, "Cannot open \"%s\": %s", config.shm_name.c_str(), SharedTableStatusToString(status));
+        return kExitFailure;
+    }
+    Log(log_prefix, "Watching \"%s\" (writer PID %llu)", config.shm_name.c_str(),
+        static_cast<unsigned long long>(reader.WriterPid()));
+
+    // A restarted HmiApp reuses the segment, so the watch survives it.
+    SharedDoorSnapshot last[kDoorCount];
+    uint64_t writer_pid = reader.WriterPid();
+    uint32_t seen = reader.ChangeCount();
+    bool changed = true;
+    bool writer_lost = false;
+    RateLimiter read_limiter;
+    const auto started = std::chrono::steady_clock::now();
+    while (g_running.load()) {
+        if (config.duration_s > 0 && std::chrono::steady_clock::now() - started >= std::chrono::seconds(config.duration_s)) {
+            break;
+        }
+        if (!changed && !reader.WaitForChange(seen, std::chrono::milliseconds(500))) {
+            // A crashed HmiApp never clears its PID; notice it on the quiet timeout instead.
+            if (!writer_lost && reader.WriterPid() != 0 && !reader.WriterAlive()) {
+                writer_lost = true;
+                Log(log_prefix, "HmiApp PID %llu exited without closing the door table; waiting for it to restart",
+                    static_cast<unsigned long long>(reader.WriterPid()));
+            }
+            continue;
+        }
+        changed = false;
+        if (reader.WriterPid() != writer_pid) {
+            writer_pid = reader.WriterPid();
+            writer_lost = false;
+            if (writer_pid == 0) {
+                Log(log_prefix, "HmiApp closed the door table; waiting for it to restart");
+            } else {
+                Log(log_prefix, "HmiApp PID %llu is publishing", static_cast<unsigned long long>(writer_pid));
+            }
+        }
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t door = 0; door < kDoorCount; ++door) {
+            SharedDoorSnapshot snapshot;
+            if (!reader.Read(door, snapshot)) {
+                LogRateLimited(log_prefix, read_limiter, std::chrono::seconds(5),
+                               "Door %zu record left mid-update by a dead HmiApp; waiting for it to restart", door + 1);
+                continue;
+            }
+            if (snapshot.updates == 0) {
+                continue;
+            }
+            if (snapshot.state != last[door].state || snapshot.obstruction != last[door].obstruction ||
+                snapshot.fault_code != last[door].fault_code || last[door].updates == 0) {
+                Log(log_prefix, "Door %zu %s obs=%u fault=%u (frame %.1f us ago, published %.1f us ago)", door + 1,
+                    DoorStateToString(snapshot.state), static_cast<unsigned>(snapshot.obstruction),
+                    static_cast<unsigned>(snapshot.fault_code),
+                    ToUs(std::chrono::duration_cast<std::chrono::nanoseconds>(now - snapshot.last_update).count()),
+                    ToUs(std::chrono::duration_cast<std::chrono::nanoseconds>(now - snapshot.published).count()));
+            }
+            last[door] = snapshot;
+        }
+    }
+    return 0;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+    Config config;
+    if (!ParseArgs(argc, argv, config)) {
+        PrintUsage();
+        return kExitFailure;
+    }
+
+#ifdef _WIN32
+    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+#else
+    std::signal(SIGINT, SignalHandler);
+    std::signal(SIGTERM, SignalHandler);
+#endif
+
+    return config.watch ? RunWatch(config) : RunBenchmark(config);
+}
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+
+#include "CANAPI_Types.h"
+
+#include "CanFrameTiming.h"
+#include "Logging.h"
+
+namespace raildoor {
+
+enum class TimingVerdict : uint8_t {
+    Ok = 0,
+    Warning = 1,
+    Infeasible = 2
+};
+
+inline const char *TimingVerdictToString(TimingVerdict verdict) {
+    switch (verdict) {
+        case TimingVerdict::Ok:
+            return "OK";
+        case TimingVerdict::Warning:
+            return "WARNING";
+        case TimingVerdict::Infeasible:
+            return "INFEASIBLE";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+struct CanMessageTiming {
+    uint32_t id = 0;
+    uint8_t dlc = 8;
+    bool sporadic = false;  // period is a minimum inter-arrival time
+    int64_t period_ns = 0;
+    int64_t deadline_ns = 0;  // the period, or the ICD minimum inter-arrival for sporadic messages
+    int64_t transmission_ns = 0;
+    int64_t blocking_ns = 0;
+    int64_t queuing_ns = 0;
+    int64_t response_ns = 0;
+    TimingVerdict verdict = TimingVerdict::Ok;
+    TimingVerdict reported = TimingVerdict::Ok;
+};
+
+// Worst-case response-time analysis for 11-bit classic CAN (Davis et al. 2007, sufficient test):
+//
+//   w = max(B_m, C_m) + sum_{k in hp(m)} ceil((w + tau_bit) / T_k) * C_k,   R_m = w + C_m <= D_m
+//
+// with B_m the longest lower-priority frame and C the worst-case stuffed transmission time.
+//
+// The message set is kept sorted by ID (= priority). Changing one message only invalidates the
+// messages below it (interference) and, when its frame length changed, the blocking term of those
+// above it; Update() re-analyses only those. While periods only shrink and lengths only grow, each
+// fixed-point iteration restarts from the previous queuing delay, which is still a lower bound.
+class ResponseTimeAnalysis {
+public:
+    static constexpr size_t kMaxMessages = 64;
+    static constexpr int kMaxIterations = 100000;
+
+    ResponseTimeAnalysis() {
+        index_.fill(-1);
+    }
+
+    void SetBitrate(uint32_t bits_per_second) {
+        bit_ns_ = 1000000000LL / static_cast<int64_t>(bits_per_second == 0 ? 1U : bits_per_second);
+        for (size_t i = 0; i < count_; ++i) {
+            entries_[i].transmission_ns = TransmissionNs(entries_[i].dlc);
+        }
+        dirty_from_ = 0;
+        blocking_dirty_ = true;
+        relaxed_ = true;
+    }
+
+    void SetWarningRatio(double ratio) {
+        warning_ratio_ = ratio;
+    }
+
+    // Adds or updates a message. deadline_ns 0 is the implicit deadline, equal to the period.
+    // Returns false when the ID is not 11-bit or the set is full.
+    bool Upsert(uint32_t id, uint8_t dlc, int64_t period_ns, bool sporadic, int64_t deadline_ns = 0) {
+        if (id > kMaxStandardId || period_ns <= 0) {
+            return false;
+        }
+        const int64_t transmission_ns = TransmissionNs(dlc);
+        const int64_t deadline = deadline_ns > 0 ? deadline_ns : period_ns;
+        int16_t index = index_[id];
+        if (index < 0) {
+            if (count_ == kMaxMessages) {
+                return false;
+            }
+            size_t pos = 0;
+            while (pos < count_ && entries_[pos].id < id) {
+                ++pos;
+            }
+            for (size_t i = count_; i > pos; --i) {
+                entries_[i] = entries_[i - 1];
+                index_[entries_[i].id] = static_cast<int16_t>(i);
+            }
+            ++count_;
+            CanMessageTiming &entry = entries_[pos];
+            entry = CanMessageTiming{};
+            entry.id = id;
+            entry.dlc = dlc;
+            entry.sporadic = sporadic;
+            entry.period_ns = period_ns;
+            entry.deadline_ns = deadline;
+            entry.transmission_ns = transmission_ns;
+            index_[id] = static_cast<int16_t>(pos);
+            // A new message only adds interference and blocking, so warm starts stay valid; its own
+            // queuing delay starts at zero and therefore from the base term.
+            MarkDirty(pos);
+            blocking_dirty_ = true;
+            return true;
+        }
+
+        CanMessageTiming &entry = entries_[static_cast<size_t>(index)];
+        entry.sporadic = sporadic;
+        if (transmission_ns != entry.transmission_ns) {
+            relaxed_ = relaxed_ || transmission_ns < entry.transmission_ns;
+            entry.dlc = dlc;
+            entry.transmission_ns = transmission_ns;
+            blocking_dirty_ = true;
+            MarkDirty(static_cast<size_t>(index));
+        }
+        if (period_ns != entry.period_ns) {
+            relaxed_ = relaxed_ || period_ns > entry.period_ns;
+            entry.period_ns = period_ns;
+            MarkDirty(static_cast<size_t>(index));
+        }
+        if (deadline != entry.deadline_ns) {
+            // The deadline only bounds the iteration and the verdict, so warm starts stay valid.
+            entry.deadline_ns = deadline;
+            MarkDirty(static_cast<size_t>(index));
+        }
+        return true;
+    }
+
+    const CanMessageTiming *Find(uint32_t id) const {
+        if (id > kMaxStandardId || index_[id] < 0) {
+            return nullptr;
+        }
+        return &entries_[static_cast<size_t>(index_[id])];
+    }
+
+    // Re-analyses whatever Upsert invalidated since the last call.
+    void Update() {
+        if (dirty_from_ >= count_ && !blocking_dirty_) {
+            return;
+        }
+
+        std::array<int64_t, kMaxMessages> blocking{};
+        int64_t longest_below = 0;
+        for (size_t i = count_; i-- > 0;) {
+            blocking[i] = longest_below;
+            longest_below = std::max(longest_below, entries_[i].transmission_ns);
+        }
+
+        utilisation_ = 0.0;
+        for (size_t i = 0; i < count_; ++i) {
+            const CanMessageTiming &entry = entries_[i];
+            utilisation_ += static_cast<double>(entry.transmission_ns) / static_cast<double>(entry.period_ns);
+        }
+
+        const bool warm = !relaxed_;
+        for (size_t i = 0; i < count_; ++i) {
+            const bool interference_changed = i >= dirty_from_;
+            const bool blocking_changed = blocking[i] != entries_[i].blocking_ns;
+            if (interference_changed || blocking_changed) {
+                Analyse(i, blocking[i], warm);
+            }
+        }
+        dirty_from_ = count_;
+        blocking_dirty_ = false;
+        relaxed_ = false;
+    }
+
+    size_t Count() const {
+        return count_;
+    }
+
+    const CanMessageTiming &At(size_t index) const {
+        return entries_[index];
+    }
+
+    CanMessageTiming &At(size_t index) {
+        return entries_[index];
+    }
+
+    // Sum of C/T over the analysed set, as of the last Update().
+    double Utilisation() const {
+        return utilisation_;
+    }
+
+    uint64_t AnalysedMessages() const {
+        return analysed_;
+    }
+
+    uint64_t Iterations() const {
+        return iterations_;
+    }
+
+private:
+    int64_t TransmissionNs(uint8_t dlc) const {
+        return static_cast<int64_t>(WorstCaseFrameBits(false, std::min<uint8_t>(dlc, 8U))) * bit_ns_;
+    }
+
+    void MarkDirty(size_t index) {
+        dirty_from_ = std::min(dirty_from_, index);
+    }
+
+    void Analyse(size_t index, int64_t blocking_ns, bool warm) {
+        CanMessageTiming &entry = entries_[index];
+        entry.blocking_ns = blocking_ns;
+        const int64_t base = std::max(blocking_ns, entry.transmission_ns);
+        const int64_t limit = entry.deadline_ns - entry.transmission_ns;
+        int64_t w = (warm && entry.queuing_ns > base) ? entry.queuing_ns : base;
+        bool feasible = true;
+        for (int iteration = 0;; ++iteration) {
+            ++iterations_;
+            int64_t next = base;
+            for (size_t k = 0; k < index; ++k) {
+                const CanMessageTiming &hp = entries_[k];
+                next += ((w + bit_ns_ + hp.period_ns - 1) / hp.period_ns) * hp.transmission_ns;
+            }
+            if (next == w) {
+                break;
+            }
+            w = next;
+            if (w > limit || iteration >= kMaxIterations) {
+                feasible = false;
+                break;
+            }
+        }
+        ++analysed_;
+        entry.queuing_ns = w;
+        entry.response_ns = w + entry.transmission_ns;
+        if (!feasible || entry.response_ns > entry.deadline_ns) {
+            entry.verdict = TimingVerdict::Infeasible;
+        } else if (static_cast<double>(entry.response_ns) > warning_ratio_ * static_cast<double>(entry.deadline_ns)) {
+            entry.verdict = TimingVerdict::Warning;
+        } else {
+            entry.verdict = TimingVerdict::Ok;
+        }
+    }
+
+    std::array<CanMessageTiming, kMaxMessages> entries_{};
+    std::array<int16_t, kMaxStandardId + 1> index_{};
+    size_t count_ = 0;
+    size_t dirty_from_ = 0;
+    bool blocking_dirty_ = false;
+    bool relaxed_ = false;
+    int64_t bit_ns_ = 2000;  // 500 kbit/s
+    double warning_ratio_ = 0.8;
+    double utilisation_ = 0.0;
+    uint64_t analysed_ = 0;
+    uint64_t iterations_ = 0;
+};
+
+struct BusReport {
+    double load_pct = 0.0;       // measured, last full second
+    double peak_load_pct = 0.0;  // highest full-second load seen
+    double analysed_utilisation_pct = 0.0;
+    size_t messages = 0;
+    uint32_t worst_id = 0;
+    double worst_response_ms = 0.0;
+    double worst_deadline_ms = 0.0;
+    TimingVerdict worst_verdict = TimingVerdict::Ok;
+    uint64_t analysed_messages = 0;
+    uint64_t iterations = 0;
+};
+
+// Live bus load from exact frame lengths plus response-time analysis of the frame set.
+//
+// The analysed set starts from the ICD (AddMessage) and follows the bus: every 11-bit ID seen
+// twice is added, and periods are re-estimated from inter-arrival times (smoothed, committed only
+// on a >5% change so jitter does not keep invalidating the analysis). Sporadic messages track the
+// shortest inter-arrival seen, relaxing back up after a burst, but never below the ICD minimum
+// inter-arrival time, which also stays their deadline: a burst of operator commands is not a new
+// contract. Only frames this node receives or sends are counted, so a kernel acceptance filter
+// hides the rest of the bus from the load figure.
+//
+// Thread-safe: OnFrame is called from the rx path and after each successful write, Refresh from
+// the display thread. All storage is inline, so steady state does not allocate.
+class BusMonitor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int64_t kSlotNs = 100000000;  // 100 ms
+    static constexpr size_t kSlots = 10;           // 1 s window
+
+    BusMonitor(const char *log_prefix, uint32_t bits_per_second, double warning_ratio)
+        : log_prefix_(log_prefix), bits_per_second_(bits_per_second) {
+        analysis_.SetBitrate(bits_per_second);
+        analysis_.SetWarningRatio(warning_ratio);
+    }
+
+    void AddMessage(uint32_t id, uint8_t dlc, std::chrono::milliseconds period, bool sporadic) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const int64_t period_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(period).count();
+        const int64_t deadline_ns = sporadic ? period_ns : 0;
+        if (analysis_.Upsert(id, dlc, period_ns, sporadic, deadline_ns) && id <= kMaxStandardId) {
+            tracks_[id].committed_ns = period_ns;
+            tracks_[id].min_interval_ns = deadline_ns;
+            tracks_[id].sporadic = sporadic;
+        }
+    }
+
+    void OnFrame(const CANAPI_Message_t &message, Clock::time_point time) {
+        if (message.sts != 0) {
+            return;  // status/error frames carry no payload length to account for
+        }
+        const uint32_t bits = ExactFrameBits(message.id, message.xtd != 0, message.rtr != 0, message.dlc, message.data);
+        const int64_t now_ns = ToNs(time);
+        std::lock_guard<std::mutex> lock(mutex_);
+        AdvanceSlots(now_ns);
+        slots_[current_slot_ % kSlots] += bits;
+
+        if (message.xtd != 0 || message.id > kMaxStandardId) {
+            return;
+        }
+        IdTrack &track = tracks_[message.id];
+        const int64_t last_ns = track.last_ns;
+        track.last_ns = now_ns;
+        if (last_ns == 0 || now_ns <= last_ns) {
+            return;
+        }
+        const int64_t gap = now_ns - last_ns;
+        if (track.estimate_ns == 0) {
+            track.estimate_ns = gap;
+        } else if (gap < 4 * track.estimate_ns) {
+            // Longer gaps are pauses (sender restarted, bus off), not a new period.
+            track.estimate_ns += (gap - track.estimate_ns) / 8;
+        }
+
+        int64_t period_ns = track.committed_ns;
+        if (track.sporadic) {
+            // Shortest gap, relaxing towards later gaps so one burst is not kept for good.
+            track.burst_ns = (track.burst_ns == 0 || gap < track.burst_ns)
+                                 ? gap
+                                 : track.burst_ns + (gap - track.burst_ns) / 8;
+            const int64_t candidate = std::max(track.burst_ns, track.min_interval_ns);
+            if (period_ns == 0 || std::abs(candidate - period_ns) * 20 > period_ns) {
+                period_ns = candidate;
+            }
+        } else if (period_ns == 0 || std::abs(track.estimate_ns - period_ns) * 20 > period_ns) {
+            period_ns = track.estimate_ns;
+        }
+        if (period_ns != track.committed_ns || message.dlc != track.dlc) {
+            if (analysis_.Upsert(message.id, message.dlc, period_ns, track.sporadic, track.min_interval_ns)) {
+                track.committed_ns = period_ns;
+                track.dlc = message.dlc;
+            }
+        }
+    }
+
+    // Brings the analysis up to date, logs verdict changes and returns the current figures.
+    BusReport Refresh(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AdvanceSlots(ToNs(now));
+        analysis_.Update();
+
+        BusReport report;
+        report.load_pct = last_window_load_ * 100.0;
+        report.peak_load_pct = peak_window_load_ * 100.0;
+        report.analysed_utilisation_pct = analysis_.Utilisation() * 100.0;
+        report.messages = analysis_.Count();
+        report.analysed_messages = analysis_.AnalysedMessages();
+        report.iterations = analysis_.Iterations();
+
+        double worst_ratio = -1.0;
+        for (size_t i = 0; i < analysis_.Count(); ++i) {
+            CanMessageTiming &entry = analysis_.At(i);
+            const double ratio = static_cast<double>(entry.response_ns) / static_cast<double>(entry.deadline_ns);
+            if (ratio > worst_ratio) {
+                worst_ratio = ratio;
+                report.worst_id = entry.id;
+                report.worst_response_ms = entry.response_ns / 1e6;
+                report.worst_deadline_ms = entry.deadline_ns / 1e6;
+                report.worst_verdict = entry.verdict;
+            }
+            if (entry.verdict != entry.reported) {
+                if (entry.verdict == TimingVerdict::Ok) {
+                    Log(log_prefix_, "Timing 0x%03X back to OK: R=%.3f ms, D=%.1f ms", static_cast<unsigned>(entry.id),
+                        entry.response_ns / 1e6, entry.deadline_ns / 1e6);
+                } else {
+                    LogError(log_prefix_, "Timing 0x%03X %s: worst-case R=%.3f ms vs D=%.1f ms (U=%.1f%%)",
+                             static_cast<unsigned>(entry.id), TimingVerdictToString(entry.verdict),
+                             entry.response_ns / 1e6, entry.deadline_ns / 1e6, analysis_.Utilisation() * 100.0);
+                }
+                entry.reported = entry.verdict;
+            }
+        }
+        return report;
+    }
+
+private:
+    struct IdTrack {
+        int64_t last_ns = 0;
+        int64_t estimate_ns = 0;
+        int64_t committed_ns = 0;
+        int64_t burst_ns = 0;         // sporadic: shortest recent gap
+        int64_t min_interval_ns = 0;  // sporadic: ICD minimum inter-arrival, also the deadline
+        uint8_t dlc = 0;
+        bool sporadic = false;
+    };
+
+    static int64_t ToNs(Clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    // Rolls the 100 ms slot ring forward to now, closing full-second windows on the way.
+    void AdvanceSlots(int64_t now_ns) {
+        const int64_t slot = now_ns / kSlotNs;
+        if (current_slot_ == 0) {
+            current_slot_ = slot;
+            return;
+        }
+        if (slot <= current_slot_) {
+            return;
+        }
+        const int64_t steps = std::min<int64_t>(slot - current_slot_, static_cast<int64_t>(kSlots) + 1);
+        for (int64_t i = 0; i < steps; ++i) {
+            // The window is the kSlots slots before the one being opened.
+            uint64_t window_bits = 0;
+            for (size_t k = 0; k < kSlots; ++k) {
+                window_bits += slots_[k];
+            }
+            last_window_load_ = static_cast<double>(window_bits) / static_cast<double>(bits_per_second_);
+            peak_window_load_ = std::max(peak_window_load_, last_window_load_);
+            ++current_slot_;
+            slots_[current_slot_ % kSlots] = 0;
+        }
+        current_slot_ = slot;
+    }
+
+    const char *log_prefix_;
+    uint32_t bits_per_second_;
+    std::mutex mutex_;
+    ResponseTimeAnalysis analysis_;
+    std::array<IdTrack, kMaxStandardId + 1> tracks_{};
+    std::array<uint64_t, kSlots> slots_{};
+    int64_t current_slot_ = 0;
+    double last_window_load_ = 0.0;
+    double peak_window_load_ = 0.0;
+};
+
+}  // namespace raildoor
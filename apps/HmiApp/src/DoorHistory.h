@@ -0,0 +1,283 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DoorProtocol.h"
+#include "DurationHistogram.h"
+
+namespace raildoor {
+
+// Totals since the first status frame, including the run still in progress.
+struct DoorHistorySummary {
+    std::array<int64_t, 4> time_in_state_ms{};  // indexed by DoorState
+    uint64_t transitions = 0;
+    uint64_t cycles = 0;  // CLOSED -> ... -> OPEN -> ... -> CLOSED
+    uint64_t fault_episodes = 0;
+    int64_t fault_ms = 0;
+    DurationStats opening;  // MOVING runs that ended OPEN
+    DurationStats closing;  // MOVING runs that ended CLOSED
+    DurationStats cycle;    // leaving CLOSED until CLOSED again, for completed cycles
+    size_t stored_runs = 0;
+    uint64_t evicted_runs = 0;
+    size_t used_bytes = 0;
+    size_t budget_bytes = 0;
+};
+
+struct DoorRun {
+    int64_t start_ms = 0;  // relative to the first observed frame, 10 ms resolution
+    DoorState state = DoorState::Closed;
+    uint8_t obstruction = 0;
+    uint8_t fault_code = 0;
+};
+
+// Per-door timeline of status runs with a fixed memory budget.
+//
+// The 10 Hz status stream is run-length encoded: a record is written only when state,
+// obstruction or fault code changes, and stands for every identical frame after it. Records are
+// delta-encoded into a byte ring:
+//
+//   byte 0   [1:0] state  [2] obstruction  [3] fault byte follows
+//   varint   ticks (10 ms) since the previous record, LEB128
+//   [byte]   fault code, only when it differs from the previous record
+//
+// A typical run costs 2-3 bytes. When the ring is full the oldest records are evicted; the
+// aggregates (state times, cycles, fault episodes, duration histograms) are updated as runs close,
+// so Summarize() is O(1) and covers the whole uptime, not just what is still in the ring.
+//
+// Not thread-safe; HmiApp guards it with door_mutex. Storage is allocated in the constructor only.
+class DoorHistory {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int64_t kTickMs = 10;
+    static constexpr size_t kMaxRecordBytes = 1 + 5 + 1;
+    static constexpr uint64_t kMaxDeltaTicks = (1ULL << 35) - 1;
+
+    explicit DoorHistory(size_t budget_bytes) : ring_(budget_bytes < kMaxRecordBytes ? kMaxRecordBytes : budget_bytes) {}
+
+    // Feeds one received status frame. An unchanged status only extends the current run. state must
+    // be one of the four ICD states (IsKnownDoorState); the encoding has two bits for it.
+    void Observe(Clock::time_point time, DoorState state, uint8_t obstruction, uint8_t fault_code) {
+        if (!started_) {
+            started_ = true;
+            epoch_ = time;
+            OpenRun(0, state, obstruction, fault_code);
+            return;
+        }
+        if (state == current_.state && obstruction == current_.obstruction && fault_code == current_.fault_code) {
+            return;
+        }
+
+        int64_t now_ms = ElapsedMs(time);
+        if (now_ms < current_.start_ms) {
+            now_ms = current_.start_ms;
+        }
+        CloseRun(now_ms, state);
+        OpenRun(now_ms, state, obstruction, fault_code);
+    }
+
+    DoorHistorySummary Summarize(Clock::time_point now) const {
+        DoorHistorySummary summary;
+        summary.time_in_state_ms = time_in_state_ms_;
+        summary.fault_ms = fault_ms_;
+        if (started_) {
+            int64_t open_ms = ElapsedMs(now) - current_.start_ms;
+            if (open_ms > 0) {
+                summary.time_in_state_ms[StateIndex(current_.state)] += open_ms;
+                if (IsFaulted(current_.state, current_.fault_code)) {
+                    summary.fault_ms += open_ms;
+                }
+            }
+        }
+        summary.transitions = transitions_;
+        summary.cycles = cycles_;
+        summary.fault_episodes = fault_episodes_;
+        summary.opening = SummarizeDurations(opening_);
+        summary.closing = SummarizeDurations(closing_);
+        summary.cycle = SummarizeDurations(cycle_);
+        summary.stored_runs = stored_runs_;
+        summary.evicted_runs = evicted_runs_;
+        summary.used_bytes = used_;
+        summary.budget_bytes = ring_.size();
+        return summary;
+    }
+
+    // Decodes the retained runs, oldest first. fn(const DoorRun &).
+    template <typename Fn>
+    void ForEachRun(Fn &&fn) const {
+        size_t pos = tail_;
+        int64_t ticks = base_ticks_;
+        uint8_t fault = base_fault_;
+        for (size_t i = 0; i < stored_runs_; ++i) {
+            DoorRun run;
+            size_t length = Decode(pos, ticks, fault, run);
+            fn(run);
+            pos = (pos + length) % ring_.size();
+        }
+    }
+
+private:
+    static size_t StateIndex(DoorState state) {
+        return static_cast<size_t>(state) & 3U;
+    }
+
+    static bool IsFaulted(DoorState state, uint8_t fault_code) {
+        return state == DoorState::Faulted || fault_code != 0;
+    }
+
+    int64_t ElapsedMs(Clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time - epoch_).count();
+    }
+
+    static uint32_t ClampMs(int64_t ms) {
+        return ms > static_cast<int64_t>(UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(ms);
+    }
+
+    void CloseRun(int64_t end_ms, DoorState next_state) {
+        const int64_t duration = end_ms - current_.start_ms;
+        time_in_state_ms_[StateIndex(current_.state)] += duration;
+        if (IsFaulted(current_.state, current_.fault_code)) {
+            fault_ms_ += duration;
+        }
+        if (current_.state == DoorState::Moving) {
+            if (next_state == DoorState::Open) {
+                opening_.Add(ClampMs(duration));
+            } else if (next_state == DoorState::Closed) {
+                closing_.Add(ClampMs(duration));
+            }
+        }
+        if (current_.state == DoorState::Closed && next_state != DoorState::Closed) {
+            cycle_start_ms_ = end_ms;
+            cycle_opened_ = false;
+            in_cycle_ = true;
+        }
+        ++transitions_;
+    }
+
+    void OpenRun(int64_t start_ms, DoorState state, uint8_t obstruction, uint8_t fault_code) {
+        const bool was_faulted = started_runs_ > 0 && IsFaulted(current_.state, current_.fault_code);
+        if (!was_faulted && IsFaulted(state, fault_code)) {
+            ++fault_episodes_;
+        }
+        if (state == DoorState::Open) {
+            cycle_opened_ = true;
+        }
+        if (state == DoorState::Closed && in_cycle_) {
+            if (cycle_opened_) {
+                ++cycles_;
+                cycle_.Add(ClampMs(start_ms - cycle_start_ms_));
+            }
+            in_cycle_ = false;
+        }
+
+        const uint8_t previous_fault = started_runs_ > 0 ? current_.fault_code : base_fault_;
+        current_.start_ms = start_ms;
+        current_.state = state;
+        current_.obstruction = obstruction;
+        current_.fault_code = fault_code;
+        ++started_runs_;
+        Append(start_ms / kTickMs, state, obstruction, fault_code, previous_fault);
+    }
+
+    void Append(int64_t ticks, DoorState state, uint8_t obstruction, uint8_t fault_code, uint8_t previous_fault) {
+        uint8_t record[kMaxRecordBytes];
+        size_t length = 0;
+        const bool fault_changed = (fault_code != previous_fault);
+        record[length++] = static_cast<uint8_t>(StateIndex(state) | (obstruction ? 0x04U : 0U) |
+                                                (fault_changed ? 0x08U : 0U));
+        // Five varint bytes cover ~10 years between changes; clamp rather than overflow the record.
+        uint64_t delta = static_cast<uint64_t>(ticks - head_ticks_);
+        if (delta > kMaxDeltaTicks) {
+            delta = kMaxDeltaTicks;
+        }
+        head_ticks_ += static_cast<int64_t>(delta);
+        do {
+            uint8_t byte = static_cast<uint8_t>(delta & 0x7FU);
+            delta >>= 7;
+            record[length++] = static_cast<uint8_t>(byte | (delta != 0 ? 0x80U : 0U));
+        } while (delta != 0);
+        if (fault_changed) {
+            record[length++] = fault_code;
+        }
+
+        while (ring_.size() - used_ < length) {
+            EvictOldest();
+        }
+        for (size_t i = 0; i < length; ++i) {
+            ring_[head_] = record[i];
+            head_ = (head_ + 1) % ring_.size();
+        }
+        used_ += length;
+        ++stored_runs_;
+    }
+
+    void EvictOldest() {
+        DoorRun run;
+        size_t length = Decode(tail_, base_ticks_, base_fault_, run);
+        tail_ = (tail_ + length) % ring_.size();
+        used_ -= length;
+        --stored_runs_;
+        ++evicted_runs_;
+    }
+
+    // Decodes the record at pos. ticks/fault hold the previous record's values on entry and this
+    // record's on return. Returns the record length.
+    size_t Decode(size_t pos, int64_t &ticks, uint8_t &fault, DoorRun &run) const {
+        const size_t size = ring_.size();
+        size_t length = 0;
+        const uint8_t header = ring_[pos];
+        ++length;
+        uint64_t delta = 0;
+        uint32_t shift = 0;
+        uint8_t byte = 0;
+        do {
+            byte = ring_[(pos + length) % size];
+            ++length;
+            delta |= static_cast<uint64_t>(byte & 0x7FU) << shift;
+            shift += 7;
+        } while ((byte & 0x80U) != 0);
+        if ((header & 0x08U) != 0) {
+            fault = ring_[(pos + length) % size];
+            ++length;
+        }
+        ticks += static_cast<int64_t>(delta);
+        run.start_ms = ticks * kTickMs;
+        run.state = static_cast<DoorState>(header & 0x03U);
+        run.obstruction = (header & 0x04U) ? 1U : 0U;
+        run.fault_code = fault;
+        return length;
+    }
+
+    std::vector<uint8_t> ring_;
+    size_t head_ = 0;
+    size_t tail_ = 0;
+    size_t used_ = 0;
+    size_t stored_runs_ = 0;
+    uint64_t evicted_runs_ = 0;
+    int64_t head_ticks_ = 0;  // ticks of the newest record
+    int64_t base_ticks_ = 0;  // ticks of the record before the oldest one
+    uint8_t base_fault_ = 0;  // fault code in effect before the oldest record
+
+    bool started_ = false;
+    Clock::time_point epoch_{};
+    DoorRun current_;
+    uint64_t started_runs_ = 0;
+
+    std::array<int64_t, 4> time_in_state_ms_{};
+    uint64_t transitions_ = 0;
+    uint64_t cycles_ = 0;
+    uint64_t fault_episodes_ = 0;
+    int64_t fault_ms_ = 0;
+    bool in_cycle_ = false;
+    bool cycle_opened_ = false;
+    int64_t cycle_start_ms_ = 0;
+    DurationHistogram opening_;
+    DurationHistogram closing_;
+    DurationHistogram cycle_;
+};
+
+}  // namespace raildoor
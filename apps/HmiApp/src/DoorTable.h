@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "CANAPI_Types.h"
+
+#include "DoorHistory.h"
+#include "DoorProtocol.h"
+#include "Logging.h"
+
+namespace raildoor {
+
+// Timing assumption: DoorNode status TX defaults to 100 ms, so a 500 ms threshold marks a door
+// as STALE after ~5 missed updates.
+constexpr auto kStaleThreshold = std::chrono::milliseconds(500);
+
+struct DoorInfo {
+    DoorState state = DoorState::Closed;
+    uint8_t obstruction = 0;
+    uint8_t fault_code = 0;
+    std::chrono::steady_clock::time_point last_update{};
+};
+
+inline bool IsStale(const DoorInfo &info, std::chrono::steady_clock::time_point now) {
+    return info.last_update.time_since_epoch().count() == 0 || now - info.last_update > kStaleThreshold;
+}
+
+// The HMI's view of the doors, built from status frames. Receive times are passed in, so the same
+// code runs under HmiApp's threads and under DoorSim's virtual clock. Not thread-safe: HmiApp
+// holds its door mutex around every call.
+class DoorTable {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    // Allocates the history stores once here; nothing grows after construction.
+    DoorTable(const char *log_prefix, size_t history_bytes)
+        : log_prefix_(log_prefix), histories_(kDoorCount, DoorHistory(history_bytes)) {}
+
+    // Applies a status frame received at rx_time. Returns the 1-based door ID it updated, or 0 if
+    // the frame is not a door status frame.
+    uint8_t OnStatusFrame(const CANAPI_Message_t &message, time_point rx_time) {
+        if (message.sts != 0 || message.xtd != 0 || message.rtr != 0) {
+            return 0;
+        }
+        if (message.id < kStatusIdBase || message.id > kStatusIdMax || message.dlc < 4) {
+            return 0;
+        }
+
+        uint8_t state_raw = message.data[0];
+        uint8_t obstruction = message.data[1];
+        uint8_t fault = message.data[2];
+        uint8_t door_id = message.data[3];
+        if (door_id < 1 || door_id > 3) {
+            door_id = static_cast<uint8_t>((message.id - kStatusIdBase) + 1U);
+        }
+
+        DoorState new_state = static_cast<DoorState>(state_raw);
+        DoorInfo &door = doors_[door_id - 1];
+        bool changed = (door.state != new_state) || (door.obstruction != obstruction) || (door.fault_code != fault);
+        door.state = new_state;
+        door.obstruction = obstruction;
+        door.fault_code = fault;
+        door.last_update = rx_time;
+        // The history packs the state into two bits, so a state outside the ICD is shown as UNKNOWN
+        // but not recorded: it would land in another state's time and could fake a cycle.
+        if (IsKnownDoorState(state_raw)) {
+            histories_[door_id - 1].Observe(rx_time, new_state, obstruction, fault);
+        }
+        if (changed) {
+            Log(log_prefix_, "Door %u -> %s obs=%u fault=%u", static_cast<unsigned>(door_id),
+                DoorStateToString(new_state), static_cast<unsigned>(obstruction), static_cast<unsigned>(fault));
+        }
+        return door_id;
+    }
+
+    const std::array<DoorInfo, kDoorCount> &Doors() const {
+        return doors_;
+    }
+
+    const DoorHistory &History(size_t door_index) const {
+        return histories_[door_index];
+    }
+
+private:
+    const char *log_prefix_;
+    std::array<DoorInfo, kDoorCount> doors_{};
+    std::vector<DoorHistory> histories_;
+};
+
+}  // namespace raildoor
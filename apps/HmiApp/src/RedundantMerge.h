@@ -0,0 +1,208 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "CANAPI_Types.h"
+
+#include "Logging.h"
+
+namespace raildoor {
+
+constexpr size_t kMaxCanLines = 4;
+
+enum class LineState : uint8_t {
+    Up,
+    Down
+};
+
+inline const char *LineStateToString(LineState state) {
+    return state == LineState::Up ? "UP" : "DOWN";
+}
+
+struct LineStats {
+    LineState state = LineState::Up;
+    uint64_t frames = 0;
+    uint64_t first_copies = 0;  // frames this line delivered before any other line
+    uint64_t duplicates = 0;
+    uint64_t missed = 0;        // frames another line delivered and this one did not
+    uint64_t down_events = 0;
+    std::chrono::steady_clock::time_point last_frame{};
+    std::chrono::steady_clock::time_point last_down{};
+    std::chrono::steady_clock::time_point last_missed{};  // receive time of the frame that took it down
+};
+
+// Merges the frames of redundant CAN lines that carry the same traffic. The first copy of a frame
+// wins and is applied; a copy with the same ID on another line within the copy window is the same
+// transmission and is dropped. So the freshest line feeds each door, and losing a line costs only
+// the frames it was first to deliver, which the other line delivers a window later at most.
+//
+// A line is DOWN once a frame another line delivered has no copy on it after twice the window
+// (the window itself plus the same again for rx-loop latency), unless it has delivered a newer
+// frame since, and UP again on its next frame.
+// With Poll called at least once per window, that is at most three windows after the first frame
+// the line lost: 60 ms at the default 20 ms. From the moment the line fails it can take longer than
+// one status period, since a failed line is only noticed once a frame it should have carried is due
+// (docs/RedundantLines.md).
+//
+// Times are passed in. Not thread-safe: HmiApp calls it under the door mutex from every rx worker.
+class RedundantMerge {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    // Frames with more distinct IDs than this are passed through without deduplication.
+    static constexpr size_t kMaxIds = 16;
+
+    RedundantMerge(const char *log_prefix, const char *const *line_names, size_t line_count,
+                   std::chrono::milliseconds window)
+        : log_prefix_(log_prefix), line_count_(line_count < kMaxCanLines ? line_count : kMaxCanLines), window_(window) {
+        for (size_t i = 0; i < line_count_; ++i) {
+            line_names_[i] = line_names[i];
+        }
+    }
+
+    size_t LineCount() const {
+        return line_count_;
+    }
+
+    // Returns true if the frame is news and should be applied, false for a copy.
+    bool OnFrame(size_t line, const CANAPI_Message_t &message, time_point rx_time) {
+        LineStats &stats = lines_[line];
+        ++stats.frames;
+        Heard(line, rx_time);
+        const uint8_t bit = static_cast<uint8_t>(1U << line);
+        Slot *slot = FindSlot(message.id);
+        if (slot == nullptr) {
+            ++stats.first_copies;
+            return true;
+        }
+        if (slot->used && line != slot->first_line && (slot->seen & bit) == 0 && Within(rx_time, slot->first_time)) {
+            slot->seen = static_cast<uint8_t>(slot->seen | bit);
+            ++stats.duplicates;
+            return false;
+        }
+        if (slot->open) {
+            // A late copy is still a sign of life; only the lines with nothing at all are missed.
+            slot->seen = static_cast<uint8_t>(slot->seen | bit);
+            Evaluate(*slot, rx_time);
+        }
+        slot->used = true;
+        slot->open = true;
+        slot->first_time = rx_time;
+        slot->first_line = static_cast<uint8_t>(line);
+        slot->seen = bit;
+        ++stats.first_copies;
+        return true;
+    }
+
+    // Closes copy windows that have expired; rx workers call it after every read, frames or not.
+    void Poll(time_point now) {
+        for (size_t i = 0; i < slot_count_; ++i) {
+            Slot &slot = slots_[i];
+            if (slot.open && now - slot.first_time > window_ + window_) {
+                Evaluate(slot, now);
+            }
+        }
+    }
+
+    // Line that delivered the last applied frame with this ID, or -1 if none has.
+    int SourceOf(uint32_t id) const {
+        for (size_t i = 0; i < slot_count_; ++i) {
+            if (slots_[i].id == id && slots_[i].used) {
+                return slots_[i].first_line;
+            }
+        }
+        return -1;
+    }
+
+    const LineStats &Line(size_t line) const {
+        return lines_[line];
+    }
+
+    const char *LineName(size_t line) const {
+        return line_names_[line];
+    }
+
+private:
+    struct Slot {
+        uint32_t id = 0;
+        bool used = false;
+        bool open = false;  // copies not yet accounted for
+        uint8_t first_line = 0;
+        uint8_t seen = 0;   // lines that delivered this frame
+        time_point first_time{};
+    };
+
+    bool Within(time_point a, time_point b) const {
+        return a > b ? a - b <= window_ : b - a <= window_;
+    }
+
+    Slot *FindSlot(uint32_t id) {
+        for (size_t i = 0; i < slot_count_; ++i) {
+            if (slots_[i].id == id) {
+                return &slots_[i];
+            }
+        }
+        if (slot_count_ == kMaxIds) {
+            return nullptr;
+        }
+        Slot &slot = slots_[slot_count_++];
+        slot.id = id;
+        return &slot;
+    }
+
+    void Evaluate(Slot &slot, time_point now) {
+        slot.open = false;
+        for (size_t line = 0; line < line_count_; ++line) {
+            if ((slot.seen & (1U << line)) != 0) {
+                continue;
+            }
+            LineStats &stats = lines_[line];
+            ++stats.missed;
+            // A line that delivered a newer frame lost this one copy but is alive, as at the end of a cut.
+            if (stats.state == LineState::Up && stats.last_frame < slot.first_time) {
+                stats.state = LineState::Down;
+                stats.last_down = now;
+                stats.last_missed = slot.first_time;
+                ++stats.down_events;
+                Log(log_prefix_, "CAN line %s DOWN: no copy of 0x%03X within %lld ms", line_names_[line],
+                    static_cast<unsigned>(slot.id), static_cast<long long>(window_.count()));
+            }
+        }
+    }
+
+    void Heard(size_t line, time_point when) {
+        LineStats &stats = lines_[line];
+        if (when > stats.last_frame) {
+            stats.last_frame = when;
+        }
+        if (stats.state == LineState::Down) {
+            stats.state = LineState::Up;
+            Log(log_prefix_, "CAN line %s UP after %lld ms", line_names_[line],
+                static_cast<long long>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(when - stats.last_down).count()));
+        }
+    }
+
+    const char *log_prefix_;
+    size_t line_count_;
+    std::chrono::milliseconds window_;
+    std::array<const char *, kMaxCanLines> line_names_{};
+    std::array<LineStats, kMaxCanLines> lines_{};
+    std::array<Slot, kMaxIds> slots_{};
+    size_t slot_count_ = 0;
+};
+
+inline void LogRedundantMerge(const char *prefix, const RedundantMerge &merge) {
+    for (size_t i = 0; i < merge.LineCount(); ++i) {
+        const LineStats &line = merge.Line(i);
+        Log(prefix, "CAN line %s: %s, %llu frames, %llu first, %llu duplicate, %llu missed, %llu down events",
+            merge.LineName(i), LineStateToString(line.state), static_cast<unsigned long long>(line.frames),
+            static_cast<unsigned long long>(line.first_copies), static_cast<unsigned long long>(line.duplicates),
+            static_cast<unsigned long long>(line.missed), static_cast<unsigned long long>(line.down_events));
+    }
+}
+
+}  // namespace raildoor
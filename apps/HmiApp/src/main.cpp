@@ -1,46 +1,84 @@
+#include <array>
 #include <atomic>
 #include <chrono>
-#include <cctype>
+#include <csignal>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
-#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
-#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <poll.h>
+#include <unistd.h>
 #endif
 
-#include "PeakCAN.h"
-#include "PCANBasic.h"
+#include "AllocationTracker.h"
+#include "BusAnalysis.h"
+#include "CanErrors.h"
+#include "Clock.h"
+#include "ControllerHealth.h"
+#include "CpuTime.h"
+#include "DoorHistory.h"
+#include "DoorProtocol.h"
+#include "DoorTable.h"
+#include "Logging.h"
+#include "PlatformCanBackend.h"
+#include "RedundantMerge.h"
+#include "SharedDoorTable.h"
 
 namespace {
-constexpr uint32_t kCommandId = 0x201U;
-constexpr uint32_t kStatusIdBase = 0x101U;
-constexpr uint32_t kStatusIdMax = 0x103U;
-constexpr int kExitFailure = 2;
+using namespace raildoor;
 
-enum class DoorState : uint8_t {
-    Closed = 0,
-    Open = 1,
-    Moving = 2,
-    Faulted = 3
-};
+constexpr int kExitFailure = 2;
+constexpr int kExitAllocations = 3;
+constexpr int kMaxRxBatch = 32;
+constexpr int kMaxHistoryKib = 4096;
+// Copies of one frame on redundant lines arrive within a few ms; the window must stay well below
+// the status period, or the next status frame would be taken for a copy.
+constexpr int kMaxMergeWindowMs = 50;
+// Analysis inputs for frames not yet seen on the bus. Status frames use the DoorNode default period;
+// commands are operator-driven, so 100 ms is a conservative minimum inter-arrival time.
+constexpr auto kIcdStatusPeriod = std::chrono::milliseconds(100);
+constexpr auto kCommandMinInterval = std::chrono::milliseconds(100);
+constexpr double kTimingWarningRatio = 0.8;
 
 struct Config {
-    std::string channel = "PCAN_USBBUS1";
+    std::vector<std::string> channels;
     std::string bitrate = "500k";
+    int duration_s = 0;
+    int rx_batch = kMaxRxBatch;
+    int history_kib = 64;
+    std::string shm_name = kDefaultSharedDoorTableName;
+    int merge_window_ms = 20;
 };
 
-struct DoorInfo {
-    DoorState state = DoorState::Closed;
-    uint8_t obstruction = 0;
-    uint8_t fault_code = 0;
-    std::chrono::steady_clock::time_point last_update{};
+// One CAN line: HmiApp runs an rx worker per line, and with several lines their frames meet in
+// RedundantMerge. Held by pointer, since the threads keep references to it.
+struct CanLine {
+    CanLine(std::string channel_name, std::string prefix)
+        : channel(std::move(channel_name)), log_prefix(std::move(prefix)), can_api(CreatePlatformCanBackend()),
+          health(log_prefix.c_str()) {}
+
+    std::string channel;
+    std::string log_prefix;
+    std::unique_ptr<CanBackend> can_api;
+    CANAPI_Bitrate_t bitrate{};
+    std::unique_ptr<BusMonitor> bus_monitor;
+    RateLimiter read_limiter;
+    RateLimiter write_limiter;
+    // The rx worker services controller health; the input thread reports write results into it.
+    std::mutex health_mutex;
+    ControllerHealth health;
+    // Held by the input thread around each write and by the rx worker around a controller restart.
+    std::mutex control_mutex;
+    std::chrono::nanoseconds rx_cpu{0};
 };
 
 std::atomic<bool> g_running{true};
@@ -53,150 +91,191 @@ BOOL WINAPI ConsoleHandler(DWORD type) {
     }
     return FALSE;
 }
-#endif
-
-std::string Timestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-    std::tm tm_snapshot{};
-#ifdef _WIN32
-    localtime_s(&tm_snapshot, &time);
 #else
-    localtime_r(&time, &tm_snapshot);
-#endif
-    std::ostringstream oss;
-    oss << std::put_time(&tm_snapshot, "%H:%M:%S") << '.' << std::setw(3) << std::setfill('0')
-        << ms.count();
-    return oss.str();
+void SignalHandler(int) {
+    g_running = false;
 }
+#endif
 
-void Log(const std::string &prefix, const std::string &message) {
-    std::cout << "[" << Timestamp() << "] " << prefix << " " << message << std::endl;
-}
+bool ParseArgs(int argc, char **argv, Config &config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--channel" && i + 1 < argc) {
+            // A comma-separated list opens one redundant line per channel.
+            std::string list = argv[++i];
+            config.channels.clear();
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) {
+                    end = list.size();
+                }
+                config.channels.push_back(list.substr(start, end - start));
+                start = end + 1;
+            }
+        } else if (arg == "--bitrate" && i + 1 < argc) {
+            config.bitrate = argv[++i];
+        } else if (arg == "--duration_s" && i + 1 < argc) {
+            config.duration_s = std::atoi(argv[++i]);
+        } else if (arg == "--rx_batch" && i + 1 < argc) {
+            config.rx_batch = std::atoi(argv[++i]);
+        } else if (arg == "--history_kib" && i + 1 < argc) {
+            config.history_kib = std::atoi(argv[++i]);
+        } else if (arg == "--shm_name" && i + 1 < argc) {
+            config.shm_name = argv[++i];
+        } else if (arg == "--merge_window_ms" && i + 1 < argc) {
+            config.merge_window_ms = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown or incomplete argument: " << arg << std::endl;
+            return false;
+        }
+    }
 
-void LogError(const std::string &prefix, const std::string &message) {
-    std::cerr << "[" << Timestamp() << "] " << prefix << " ERROR: " << message << std::endl;
-}
+    if (config.channels.empty()) {
+        config.channels.push_back(kDefaultChannel);
+    }
+    if (config.channels.size() > kMaxCanLines) {
+        std::cerr << "--channel takes at most " << kMaxCanLines << " channels" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < config.channels.size(); ++i) {
+        if (config.channels[i].empty()) {
+            std::cerr << "--channel has an empty entry" << std::endl;
+            return false;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (config.channels[j] == config.channels[i]) {
+                std::cerr << "--channel lists " << config.channels[i] << " twice" << std::endl;
+                return false;
+            }
+        }
+    }
 
-std::string DoorStateToString(DoorState state) {
-    switch (state) {
-        case DoorState::Closed:
-            return "CLOSED";
-        case DoorState::Open:
-            return "OPEN";
-        case DoorState::Moving:
-            return "MOVING";
-        case DoorState::Faulted:
-            return "FAULTED";
-        default:
-            return "UNKNOWN";
+    if (config.merge_window_ms < 1 || config.merge_window_ms > kMaxMergeWindowMs) {
+        std::cerr << "--merge_window_ms must be 1.." << kMaxMergeWindowMs << std::endl;
+        return false;
     }
-}
 
-struct RateLimiter {
-    std::chrono::steady_clock::time_point last_log{};
-    size_t suppressed = 0;
-};
+    if (config.duration_s < 0) {
+        std::cerr << "--duration_s must be >= 0" << std::endl;
+        return false;
+    }
 
-void LogRateLimited(const std::string &prefix,
-                    const std::string &message,
-                    RateLimiter &limiter,
-                    std::chrono::milliseconds interval) {
-    auto now = std::chrono::steady_clock::now();
-    if (limiter.last_log.time_since_epoch().count() == 0 ||
-        now - limiter.last_log >= interval) {
-        std::string suffix;
-        if (limiter.suppressed > 0) {
-            suffix = " (" + std::to_string(limiter.suppressed) + " similar errors suppressed)";
-            limiter.suppressed = 0;
-        }
-        Log(prefix, message + suffix);
-        limiter.last_log = now;
-    } else {
-        ++limiter.suppressed;
+    if (config.rx_batch < 1 || config.rx_batch > kMaxRxBatch) {
+        std::cerr << "--rx_batch must be 1.." << kMaxRxBatch << std::endl;
+        return false;
     }
-}
 
-std::string ErrorToString(CANAPI_Return_t rc) {
-    switch (rc) {
-        case CANERR_NOERROR:
-            return "OK";
-        case CANERR_RX_EMPTY:
-            return "RX_EMPTY";
-        case CANERR_TIMEOUT:
-            return "TIMEOUT";
-        case CPeakCAN::DriverNotLoaded:
-            return "PCAN driver not loaded";
-        case CPeakCAN::HardwareAlreadyInUse:
-            return "PCAN hardware already in use";
-        case CPeakCAN::ClientAlreadyConnected:
-            return "PCAN client already connected";
-        case CPeakCAN::RegisterTestFailed:
-            return "PCAN hardware not found";
-        default:
-            return "CAN error " + std::to_string(rc);
+    if (config.history_kib < 1 || config.history_kib > kMaxHistoryKib) {
+        std::cerr << "--history_kib must be 1.." << kMaxHistoryKib << std::endl;
+        return false;
     }
+    return true;
 }
 
-bool TryParseChannel(const std::string &text, uint32_t &channel) {
-    if (text.rfind("PCAN_USBBUS", 0) == 0) {
-        std::string suffix = text.substr(std::string("PCAN_USBBUS").size());
-        int index = std::atoi(suffix.c_str());
-        static const uint32_t kUsbMap[] = {
-            PCAN_USBBUS1,  PCAN_USBBUS2,  PCAN_USBBUS3,  PCAN_USBBUS4,
-            PCAN_USBBUS5,  PCAN_USBBUS6,  PCAN_USBBUS7,  PCAN_USBBUS8,
-            PCAN_USBBUS9,  PCAN_USBBUS10, PCAN_USBBUS11, PCAN_USBBUS12,
-            PCAN_USBBUS13, PCAN_USBBUS14, PCAN_USBBUS15, PCAN_USBBUS16};
-        if (index >= 1 && index <= 16) {
-            channel = kUsbMap[index - 1];
-            return true;
-        }
+// Non-blocking check for a pending menu line, so the input thread can notice shutdown.
+bool InputReady() {
+    if (std::cin.rdbuf()->in_avail() > 0) {
+        return true;
     }
-
-    if (!text.empty() && (std::isdigit(static_cast<unsigned char>(text[0])) || text.rfind("0x", 0) == 0)) {
-        try {
-            channel = static_cast<uint32_t>(std::stoul(text, nullptr, 0));
-            return true;
-        } catch (...) {
-            return false;
-        }
+#ifdef _WIN32
+    // Piped commands (scripts/run_alloc_check.bat) are not buffered yet either; peek at the pipe.
+    // A closed pipe fails the peek, and getline then sees the end of input.
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    if (GetFileType(input) == FILE_TYPE_PIPE) {
+        DWORD available = 0;
+        return !PeekNamedPipe(input, nullptr, 0, nullptr, &available, nullptr) || available > 0;
     }
     return false;
+#else
+    // libstdc++ reports no buffered input for stdin, so ask the terminal directly.
+    pollfd pfd{};
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    return ::poll(&pfd, 1, 0) > 0;
+#endif
 }
 
-bool ParseArgs(int argc, char **argv, Config &config) {
-    for (int i = 1; i < argc; ++i) {
-        std::string arg = argv[i];
-        if (arg == "--channel" && i + 1 < argc) {
-            config.channel = argv[++i];
-        } else if (arg == "--bitrate" && i + 1 < argc) {
-            config.bitrate = argv[++i];
-        } else {
-            std::cerr << "Unknown or incomplete argument: " << arg << std::endl;
-            return false;
+void PrintUsage() {
+    std::cout << "HmiApp.exe [--channel PCAN_USBBUS1|can0[,can1]] [--bitrate 500k] [--duration_s 0] [--rx_batch 32]"
+              << " [--history_kib 64] [--shm_name raildoor_doortable|none] [--merge_window_ms 20]" << std::endl;
+}
+
+// Initializes, starts and filters one line. Failures are logged; the caller decides whether the
+// app can run without the line.
+bool OpenLine(CanLine &line, const std::string &bitrate_string, const uint32_t *rx_ids, size_t rx_count) {
+    const char *const log_prefix = line.log_prefix.c_str();
+    CanBackend &can_api = *line.can_api;
+    CANAPI_Return_t rc = can_api.InitializeChannel(line.channel);
+    if (rc != CANERR_NOERROR) {
+        LogError(log_prefix, "CAN init failed: %s (rc=%d)", ErrorToString(rc), rc);
+        LogError(log_prefix, "Check that the %s driver is installed, the channel is valid, and not already in use.",
+                 can_api.Name());
+        return false;
+    }
+
+    rc = can_api.StartController(line.bitrate);
+    if (rc != CANERR_NOERROR) {
+        LogError(log_prefix, "CAN start failed: %s (rc=%d)", ErrorToString(rc), rc);
+        LogError(log_prefix, "Bitrate mismatch or CAN init failure. Verify the bus is at %s.", bitrate_string.c_str());
+        can_api.TeardownChannel();
+        return false;
+    }
+
+    rc = can_api.SetReceiveFilter(rx_ids, rx_count);
+    if (rc != CANERR_NOERROR) {
+        // Not fatal: the rx loop still checks every ID in software.
+        LogError(log_prefix, "CAN receive filter failed: %s (rc=%d)", ErrorToString(rc), rc);
+    }
+
+    Log(log_prefix, "CAN init OK on %s @%s (%s)", line.channel.c_str(), bitrate_string.c_str(), can_api.Name());
+
+    uint32_t bits_per_second = 0;
+    rc = can_api.BitsPerSecond(line.bitrate, bits_per_second);
+    if (rc == CANERR_NOERROR) {
+        line.bus_monitor = std::make_unique<BusMonitor>(log_prefix, bits_per_second, kTimingWarningRatio);
+        for (uint32_t id = kStatusIdBase; id <= kStatusIdMax; ++id) {
+            line.bus_monitor->AddMessage(id, 8, kIcdStatusPeriod, false);
         }
+        line.bus_monitor->AddMessage(kCommandId, 8, kCommandMinInterval, true);
+    } else {
+        LogError(log_prefix, "Bus analysis disabled, bit rate unknown: %s (rc=%d)", ErrorToString(rc), rc);
     }
     return true;
 }
 
-CANAPI_Message_t BuildCommandMessage(uint8_t door_id, uint8_t cmd) {
-    CANAPI_Message_t message{};
-    message.id = kCommandId;
-    message.xtd = 0;
-    message.rtr = 0;
-    message.sts = 0;
-    message.dlc = 8;
-    message.data[0] = door_id;
-    message.data[1] = cmd;
-    for (int i = 2; i < 8; ++i) {
-        message.data[i] = 0;
-    }
-    return message;
+void PrintDuration(const char *label, const DurationStats &stats) {
+    std::printf("    %-8s n=%llu mean=%u p50=%u p95=%u p99=%u max=%u ms\n", label,
+                static_cast<unsigned long long>(stats.count), stats.mean_ms, stats.p50_ms, stats.p95_ms,
+                stats.p99_ms, stats.max_ms);
 }
 
-void PrintUsage() {
-    std::cout << "HmiApp.exe [--channel PCAN_USBBUS1] [--bitrate 500k]" << std::endl;
+// Prints the O(1) summary plus the last few retained runs. Uses only stack buffers, so it is
+// safe to call with allocation tracking armed.
+void PrintDoorHistory(size_t door_index, const DoorHistory &history, std::chrono::steady_clock::time_point now) {
+    const DoorHistorySummary summary = history.Summarize(now);
+    std::printf("Door %zu: %llu cycles, %llu transitions, %llu fault episodes (%.1f s faulted)\n", door_index + 1,
+                static_cast<unsigned long long>(summary.cycles), static_cast<unsigned long long>(summary.transitions),
+                static_cast<unsigned long long>(summary.fault_episodes), summary.fault_ms / 1000.0);
+    std::printf("    time   CLOSED %.1f s  OPEN %.1f s  MOVING %.1f s  FAULTED %.1f s\n",
+                summary.time_in_state_ms[0] / 1000.0, summary.time_in_state_ms[1] / 1000.0,
+                summary.time_in_state_ms[2] / 1000.0, summary.time_in_state_ms[3] / 1000.0);
+    PrintDuration("opening", summary.opening);
+    PrintDuration("closing", summary.closing);
+    PrintDuration("cycle", summary.cycle);
+    std::printf("    store  %zu runs, %zu/%zu bytes, %llu evicted\n", summary.stored_runs, summary.used_bytes,
+                summary.budget_bytes, static_cast<unsigned long long>(summary.evicted_runs));
+
+    constexpr size_t kRecentRuns = 4;
+    DoorRun recent[kRecentRuns];
+    size_t seen = 0;
+    history.ForEachRun([&](const DoorRun &run) { recent[seen++ % kRecentRuns] = run; });
+    const size_t shown = seen < kRecentRuns ? seen : kRecentRuns;
+    for (size_t i = seen - shown; i < seen; ++i) {
+        const DoorRun &run = recent[i % kRecentRuns];
+        std::printf("    +%.2f s %s obs=%u fault=%u\n", run.start_ms / 1000.0, DoorStateToString(run.state),
+                    static_cast<unsigned>(run.obstruction), static_cast<unsigned>(run.fault_code));
+    }
 }
 
 void PrintMenu() {
@@ -204,6 +283,7 @@ void PrintMenu() {
               << "  1) Open Door 1\n  2) Close Door 1\n  3) Reset Door 1\n"
               << "  4) Open Door 2\n  5) Close Door 2\n  6) Reset Door 2\n"
               << "  7) Open Door 3\n  8) Close Door 3\n  9) Reset Door 3\n"
+              << "  h) Door history summary\n"
               << "  q) Quit\n"
               << "> ";
 }
@@ -215,142 +295,243 @@ int main(int argc, char **argv) {
         PrintUsage();
         return kExitFailure;
     }
-    const std::string log_prefix = "HmiApp";
+    const char *const log_prefix = "HmiApp";
 
 #ifdef _WIN32
     SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+#else
+    std::signal(SIGINT, SignalHandler);
+    std::signal(SIGTERM, SignalHandler);
 #endif
 
-    uint32_t channel = 0;
-    if (!TryParseChannel(config.channel, channel)) {
-        LogError(log_prefix, "Invalid channel string: " + config.channel);
-        return kExitFailure;
+    // With one channel the line logs as the app does; with several, each line is named.
+    const bool redundant = config.channels.size() > 1;
+    const uint32_t rx_ids[] = {kStatusIdBase, kStatusIdBase + 1U, kStatusIdMax};
+    const size_t rx_count = sizeof(rx_ids) / sizeof(rx_ids[0]);
+    std::vector<std::unique_ptr<CanLine>> lines;
+    for (const std::string &channel : config.channels) {
+        auto line = std::make_unique<CanLine>(channel, redundant ? std::string(log_prefix) + "[" + channel + "]"
+                                                                 : std::string(log_prefix));
+        if (!line->can_api->IsValidChannel(channel)) {
+            LogError(log_prefix, "Invalid channel string: %s", channel.c_str());
+            return kExitFailure;
+        }
+        CANAPI_Return_t rc = line->can_api->ParseBitrate(config.bitrate, line->bitrate);
+        if (rc != CANERR_NOERROR) {
+            LogError(log_prefix, "Invalid bitrate string: %s", config.bitrate.c_str());
+            return kExitFailure;
+        }
+        // A redundant line that does not come up is not fatal: the others carry the same traffic.
+        if (OpenLine(*line, config.bitrate, rx_ids, rx_count)) {
+            lines.push_back(std::move(line));
+        }
     }
-
-    CANAPI_Bitrate_t bitrate{};
-    bool data = false;
-    bool sam = false;
-    CANAPI_Return_t rc = CPeakCAN::MapString2Bitrate(config.bitrate.c_str(), bitrate, data, sam);
-    if (rc != CANERR_NOERROR) {
-        LogError(log_prefix, "Invalid bitrate string: " + config.bitrate);
+    if (lines.empty()) {
+        if (redundant) {
+            LogError(log_prefix, "No CAN line could be opened");
+        }
         return kExitFailure;
     }
 
-    CPeakCAN can_api;
-    CANAPI_OpMode_t op_mode{};
-    op_mode.byte = static_cast<uint8_t>(CANMODE_DEFAULT | CANMODE_NXTD);
+    Log(log_prefix, "HmiApp started");
 
-    rc = can_api.InitializeChannel(static_cast<int32_t>(channel), op_mode);
-    if (rc != CANERR_NOERROR) {
-        LogError(log_prefix, "CAN init failed: " + ErrorToString(rc));
-        LogError(log_prefix, "Check that the PCAN driver is installed, the channel is valid, and not already in use.");
-        return kExitFailure;
+    SystemClock clock;
+    std::mutex door_mutex;
+    DoorTable door_table(log_prefix, static_cast<size_t>(config.history_kib) * 1024U);
+    // Guarded by door_mutex, so every rx worker sees one merge.
+    std::array<const char *, kMaxCanLines> line_names{};
+    for (size_t i = 0; i < lines.size(); ++i) {
+        line_names[i] = lines[i]->channel.c_str();
     }
-
-    rc = can_api.StartController(bitrate);
-    if (rc != CANERR_NOERROR) {
-        LogError(log_prefix, "CAN start failed: " + ErrorToString(rc));
-        LogError(log_prefix, "Bitrate mismatch or CAN init failure. Verify the bus is at " + config.bitrate + ".");
-        can_api.TeardownChannel();
-        return kExitFailure;
+    RedundantMerge merge(log_prefix, line_names.data(), lines.size(),
+                         std::chrono::milliseconds(config.merge_window_ms));
+    if (redundant) {
+        Log(log_prefix, "Merging %zu CAN lines, copy window %d ms", lines.size(), config.merge_window_ms);
     }
 
-    Log(log_prefix, "CAN init OK on " + config.channel + " @" + config.bitrate);
-    Log(log_prefix, "HmiApp started");
-
-    std::mutex door_mutex;
-    std::vector<DoorInfo> doors(3);
-    RateLimiter read_limiter;
-    RateLimiter write_limiter;
-    constexpr auto kStaleThreshold = std::chrono::milliseconds(500);
+    // Local processes read the door table from shared memory; see SharedDoorTable.h.
+    SharedDoorTableWriter shared_table;
+    if (config.shm_name != "none") {
+        SharedTableStatus shm_status = shared_table.Create(config.shm_name);
+        if (shm_status == SharedTableStatus::Ok) {
+            Log(log_prefix, "Publishing door table to shared memory \"%s\"", config.shm_name.c_str());
+        } else {
+            // Not fatal: the console table does not depend on it.
+            LogError(log_prefix, "Shared door table \"%s\" unavailable: %s", config.shm_name.c_str(),
+                     SharedTableStatusToString(shm_status));
+        }
+    }
 
-    std::thread rx_thread([&]() {
+    // Returns true if a door record was published to shared memory.
+    auto handle_status = [&](size_t line_index, const CANAPI_Message_t &message) {
+        const auto rx_time = lines[line_index]->can_api->ReceiveTime(message);
+        std::lock_guard<std::mutex> lock(door_mutex);
+        // A copy of a frame another line already delivered is dropped here.
+        if (redundant && message.sts == 0 && !merge.OnFrame(line_index, message, rx_time)) {
+            return false;
+        }
+        const uint8_t door_id = door_table.OnStatusFrame(message, rx_time);
+        if (door_id == 0 || !shared_table.IsOpen()) {
+            return false;
+        }
+        const DoorInfo &door = door_table.Doors()[door_id - 1U];
+        shared_table.Publish(door_id - 1U, door.state, door.obstruction, door.fault_code, door.last_update);
+        return true;
+    };
+
+    auto rx_worker = [&](size_t line_index) {
+        CanLine &line = *lines[line_index];
+        CanBackend &can_api = *line.can_api;
+        std::array<CANAPI_Message_t, kMaxRxBatch> batch{};
+        const size_t batch_size = static_cast<size_t>(config.rx_batch);
+        // Redundant workers wake once per merge window, so a dead line is noticed without waiting on
+        // the next frame.
+        const uint16_t read_timeout_ms = redundant ? static_cast<uint16_t>(config.merge_window_ms) : 100U;
         while (g_running.load()) {
-            CANAPI_Message_t message{};
-            CANAPI_Return_t rc_read = can_api.ReadMessage(message, 100U);
+            size_t count = 0;
+            CANAPI_Return_t rc_read = can_api.ReadMessages(batch.data(), batch_size, count, read_timeout_ms);
             if (rc_read == CANERR_NOERROR) {
-                if (message.sts != 0 || message.xtd != 0 || message.rtr != 0) {
-                    continue;
+                bool published = false;
+                for (size_t i = 0; i < count; ++i) {
+                    if (line.bus_monitor) {
+                        line.bus_monitor->OnFrame(batch[i], can_api.ReceiveTime(batch[i]));
+                    }
+                    published |= handle_status(line_index, batch[i]);
                 }
-                if (message.id < kStatusIdBase || message.id > kStatusIdMax || message.dlc < 4) {
-                    continue;
+                // One reader wake-up per batch, not per frame.
+                if (published) {
+                    shared_table.Notify();
                 }
-
-                uint8_t state_raw = message.data[0];
-                uint8_t obstruction = message.data[1];
-                uint8_t fault = message.data[2];
-                uint8_t door_id = message.data[3];
-                if (door_id < 1 || door_id > 3) {
-                    door_id = static_cast<uint8_t>((message.id - kStatusIdBase) + 1U);
-                }
-
-                DoorState new_state = static_cast<DoorState>(state_raw);
+            } else if (rc_read != CANERR_RX_EMPTY && rc_read != CANERR_TIMEOUT) {
+                LogRateLimited(line.log_prefix.c_str(), line.read_limiter, std::chrono::milliseconds(1000),
+                               "CAN read error: %s (rc=%d)", ErrorToString(rc_read), rc_read);
+            }
+            if (redundant) {
+                // A dead line delivers nothing, so the live lines' workers detect it.
                 std::lock_guard<std::mutex> lock(door_mutex);
-                DoorInfo &door = doors[door_id - 1];
-                bool changed = (door.state != new_state) || (door.obstruction != obstruction) || (door.fault_code != fault);
-                door.state = new_state;
-                door.obstruction = obstruction;
-                door.fault_code = fault;
-                door.last_update = std::chrono::steady_clock::now();
-                if (changed) {
-                    Log(log_prefix, "Door " + std::to_string(door_id) + " -> " +
-                                        DoorStateToString(new_state) + " obs=" +
-                                        std::to_string(obstruction) + " fault=" +
-                                        std::to_string(fault));
+                merge.Poll(clock.Now());
+            }
+
+            std::lock_guard<std::mutex> lock(line.health_mutex);
+            const auto now = clock.Now();
+            for (size_t i = 0; i < count; ++i) {
+                if (batch[i].sts != 0) {
+                    line.health.OnErrorFrame(now);
+                } else {
+                    line.health.OnTraffic(now);
                 }
-            } else if (rc_read == CANERR_RX_EMPTY || rc_read == CANERR_TIMEOUT) {
-                continue;
-            } else {
-                LogRateLimited(log_prefix, "CAN read error: " + ErrorToString(rc_read), read_limiter,
-                               std::chrono::milliseconds(1000));
             }
+            if (rc_read != CANERR_NOERROR) {
+                line.health.OnResult(rc_read, now);
+            }
+            ServiceControllerHealth(can_api, &line.control_mutex, line.health, line.bitrate, rx_ids, rx_count, now);
         }
-    });
+        line.rx_cpu = ThreadCpuTime();
+    };
+    std::vector<std::thread> rx_threads;
+    rx_threads.reserve(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        rx_threads.emplace_back(rx_worker, i);
+    }
 
     std::thread display_thread([&]() {
+        // The snapshot and the frame buffer are reused every refresh, so the loop never allocates.
+        std::array<DoorInfo, kDoorCount> snapshot{};
+        std::array<int, kDoorCount> sources{};
+        std::array<LineState, kMaxCanLines> line_states{};
+        char frame[1024];
         while (g_running.load()) {
-            std::vector<DoorInfo> snapshot;
             {
                 std::lock_guard<std::mutex> lock(door_mutex);
-                snapshot = doors;
+                snapshot = door_table.Doors();
+                for (size_t i = 0; i < kDoorCount; ++i) {
+                    sources[i] = merge.SourceOf(kStatusIdBase + static_cast<uint32_t>(i));
+                }
+                for (size_t i = 0; i < lines.size(); ++i) {
+                    line_states[i] = merge.Line(i).state;
+                }
             }
 
-            std::cout << "\nDoor Status (STALE if >" << kStaleThreshold.count() << "ms)" << std::endl;
-            std::cout << "ID  STATE     OBS  FAULT  UPDATED" << std::endl;
-            auto now = std::chrono::steady_clock::now();
+            int length = std::snprintf(frame, sizeof(frame),
+                                       "\nDoor Status (STALE if >%lldms)\nID  STATE     OBS  FAULT  UPDATED%s\n",
+                                       static_cast<long long>(kStaleThreshold.count()), redundant ? "  LINE" : "");
+            auto now = clock.Now();
             for (size_t i = 0; i < snapshot.size(); ++i) {
                 const DoorInfo &info = snapshot[i];
-                bool stale = (info.last_update.time_since_epoch().count() == 0) ||
-                             (now - info.last_update > kStaleThreshold);
-                std::string state = stale ? "STALE" : DoorStateToString(info.state);
-                std::cout << "" << (i + 1) << "   " << std::setw(8) << std::left << state << " "
-                          << std::setw(4) << std::left << static_cast<int>(info.obstruction) << " "
-                          << std::setw(5) << std::left << static_cast<int>(info.fault_code) << " "
-                          << (stale ? "-" : "OK") << std::endl;
+                bool stale = IsStale(info, now);
+                const char *state = stale ? "STALE" : DoorStateToString(info.state);
+                if (redundant) {
+                    // The line that fed this door's last update.
+                    length += std::snprintf(frame + length, sizeof(frame) - static_cast<size_t>(length),
+                                            "%zu   %-8s %-4d %-5d %-7s  %s\n", i + 1, state,
+                                            static_cast<int>(info.obstruction), static_cast<int>(info.fault_code),
+                                            stale ? "-" : "OK",
+                                            sources[i] < 0 ? "-" : lines[static_cast<size_t>(sources[i])]->channel.c_str());
+                    continue;
+                }
+                length += std::snprintf(frame + length, sizeof(frame) - static_cast<size_t>(length),
+                                        "%zu   %-8s %-4d %-5d %s\n", i + 1, state,
+                                        static_cast<int>(info.obstruction), static_cast<int>(info.fault_code),
+                                        stale ? "-" : "OK");
             }
+            for (size_t i = 0; i < lines.size(); ++i) {
+                if (redundant) {
+                    length += std::snprintf(frame + length, sizeof(frame) - static_cast<size_t>(length), "%s %s%s",
+                                            lines[i]->channel.c_str(), LineStateToString(line_states[i]),
+                                            lines[i]->bus_monitor ? ": " : "\n");
+                }
+                if (lines[i]->bus_monitor) {
+                    const BusReport report = lines[i]->bus_monitor->Refresh(now);
+                    length += std::snprintf(frame + length, sizeof(frame) - static_cast<size_t>(length),
+                                            "Bus %.1f%% (peak %.1f%%), analysed U=%.1f%% over %zu IDs, "
+                                            "worst 0x%03X R=%.2f/%.0f ms %s\n",
+                                            report.load_pct, report.peak_load_pct, report.analysed_utilisation_pct,
+                                            report.messages, static_cast<unsigned>(report.worst_id),
+                                            report.worst_response_ms, report.worst_deadline_ms,
+                                            TimingVerdictToString(report.worst_verdict));
+                }
+            }
+            if (length > static_cast<int>(sizeof(frame)) - 1) {
+                length = static_cast<int>(sizeof(frame)) - 1;
+            }
+            std::fwrite(frame, 1, static_cast<size_t>(length), stdout);
+            std::fflush(stdout);
 
-            // Timing assumption: DoorNode status TX defaults to 100 ms, so a 500 ms
-            // threshold marks a door as STALE after ~5 missed updates.
-            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            clock.SleepFor(std::chrono::milliseconds(250));
         }
     });
 
     std::thread input_thread([&]() {
         PrintMenu();
+        std::string line;
         while (g_running.load()) {
-            std::string line;
-            if (std::cin.rdbuf()->in_avail() == 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (!InputReady()) {
+                clock.SleepFor(std::chrono::milliseconds(50));
                 continue;
             }
             if (!std::getline(std::cin, line)) {
-                g_running = false;
+                // End of input ends the app, unless --duration_s bounds the run: scripted runs with
+                // stdin from /dev/null keep going until the deadline.
+                if (config.duration_s == 0) {
+                    g_running = false;
+                }
                 break;
             }
             if (line == "q" || line == "Q") {
                 g_running = false;
                 break;
             }
+            if (line == "h" || line == "H") {
+                {
+                    std::lock_guard<std::mutex> lock(door_mutex);
+                    auto now = clock.Now();
+                    for (size_t i = 0; i < kDoorCount; ++i) {
+                        PrintDoorHistory(i, door_table.History(i), now);
+                    }
+                }
+                PrintMenu();
+                continue;
+            }
 
             int selection = std::atoi(line.c_str());
             if (selection < 1 || selection > 9) {
@@ -362,31 +543,62 @@ int main(int argc, char **argv) {
             uint8_t cmd = 0;
             switch ((selection - 1) % 3) {
                 case 0:
-                    cmd = 1;  // OPEN
+                    cmd = kCommandOpen;
                     break;
                 case 1:
-                    cmd = 2;  // CLOSE
+                    cmd = kCommandClose;
                     break;
                 case 2:
-                    cmd = 3;  // RESET
+                    cmd = kCommandResetFault;
                     break;
             }
 
+            // Commands go out on every line; a door that hears two copies applies the same command twice,
+            // which leaves it in the same state.
             CANAPI_Message_t message = BuildCommandMessage(door_id, cmd);
-            CANAPI_Return_t rc_write = can_api.WriteMessage(message, 0U);
-            if (rc_write != CANERR_NOERROR) {
-                LogRateLimited(log_prefix, "CAN write error: " + ErrorToString(rc_write), write_limiter,
-                               std::chrono::milliseconds(1000));
-            } else {
-                std::string cmd_name = (cmd == 1) ? "OPEN" : (cmd == 2) ? "CLOSE" : "RESET_FAULT";
-                Log(log_prefix, "Sent " + cmd_name + " to door " + std::to_string(door_id));
+            bool sent = false;
+            for (const std::unique_ptr<CanLine> &can_line : lines) {
+                CANAPI_Return_t rc_write;
+                {
+                    std::lock_guard<std::mutex> lock(can_line->control_mutex);
+                    rc_write = can_line->can_api->WriteMessage(message);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(can_line->health_mutex);
+                    if (rc_write == CANERR_NOERROR) {
+                        can_line->health.OnWriteAccepted(clock.Now());
+                    } else {
+                        can_line->health.OnResult(rc_write, clock.Now());
+                    }
+                }
+                if (rc_write != CANERR_NOERROR) {
+                    LogRateLimited(can_line->log_prefix.c_str(), can_line->write_limiter,
+                                   std::chrono::milliseconds(1000), "CAN write error: %s (rc=%d)",
+                                   ErrorToString(rc_write), rc_write);
+                } else {
+                    if (can_line->bus_monitor) {
+                        can_line->bus_monitor->OnFrame(message, clock.Now());
+                    }
+                    sent = true;
+                }
+            }
+            if (sent) {
+                const char *cmd_name = (cmd == kCommandOpen) ? "OPEN" : (cmd == kCommandClose) ? "CLOSE" : "RESET_FAULT";
+                Log(log_prefix, "Sent %s to door %u", cmd_name, static_cast<unsigned>(door_id));
             }
             PrintMenu();
         }
     });
 
+    // Everything below this point is steady state; the tracking build fails on any allocation.
+    ArmAllocationTracking();
+
+    const auto started = clock.Now();
     while (g_running.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        clock.SleepFor(std::chrono::milliseconds(100));
+        if (config.duration_s > 0 && clock.Now() - started >= std::chrono::seconds(config.duration_s)) {
+            g_running = false;
+        }
     }
 
     Log(log_prefix, "Shutting down...");
@@ -397,13 +609,37 @@ int main(int argc, char **argv) {
     if (display_thread.joinable()) {
         display_thread.join();
     }
-    if (rx_thread.joinable()) {
-        rx_thread.join();
+    for (std::thread &rx_thread : rx_threads) {
+        if (rx_thread.joinable()) {
+            rx_thread.join();
+        }
     }
 
-    can_api.ResetController();
-    can_api.TeardownChannel();
+    const AllocationStats allocations = AllocationsSinceArmed();
+
+    shared_table.Close();
+    for (const std::unique_ptr<CanLine> &line : lines) {
+        LogCanStats(line->log_prefix.c_str(), *line->can_api, line->rx_cpu);
+        LogControllerHealth(line->log_prefix.c_str(), line->health);
+    }
+    if (redundant) {
+        LogRedundantMerge(log_prefix, merge);
+    }
+    for (const std::unique_ptr<CanLine> &line : lines) {
+        line->can_api->ResetController();
+        line->can_api->TeardownChannel();
+    }
 
     Log(log_prefix, "Shutdown complete.");
+    if (kAllocationTrackingEnabled) {
+        if (allocations.count != 0) {
+            LogError(log_prefix, "%llu steady-state allocations (%llu bytes, largest %llu)",
+                     static_cast<unsigned long long>(allocations.count),
+                     static_cast<unsigned long long>(allocations.bytes),
+                     static_cast<unsigned long long>(allocations.largest));
+            return kExitAllocations;
+        }
+        Log(log_prefix, "Allocation check passed: no steady-state allocations.");
+    }
     return 0;
 }
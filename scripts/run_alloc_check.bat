@@ -0,0 +1,112 @@
+@echo off
+setlocal
+
+REM Sustained-traffic allocation check. Build first with allocation tracking enabled:
+REM   msbuild RailDoorHMICAN.sln /p:Configuration=Debug /p:Platform=x64 /p:RailDoorTrackAllocations=true
+REM Every app exits with code 3 if it allocated after startup.
+REM
+REM   run_alloc_check.bat                 DoorSim only: door and HMI logic on the simulated bus
+REM   run_alloc_check.bat PCAN_USBBUS1    then three DoorNodes and HmiApp on that channel
+if "%~1"==":door" goto door_process
+if "%~1"==":commands" goto command_feed
+
+set "BIN_DIR=bin\x64\Debug"
+set "SIM_EXE=%BIN_DIR%\DoorSim.exe"
+set "DOOR_EXE=%BIN_DIR%\DoorNode.exe"
+set "HMI_EXE=%BIN_DIR%\HmiApp.exe"
+set "CHANNEL=%~1"
+set "DURATION_S=60"
+set /a "DOOR_DURATION_S=DURATION_S + 10"
+set "RESULT_DIR=%TEMP%\raildoor_alloc_check"
+
+if not exist "%SIM_EXE%" (
+  echo DoorSim executable not found: %SIM_EXE%
+  echo Build the solution first.
+  exit /b 1
+)
+
+REM Faults, error storms and a cut redundant line cover the error paths as well as normal traffic.
+echo DoorSim: 1000 cycles per door with faults, error storms and line cuts...
+"%SIM_EXE%" --cycles 1000 --fault_every 5 --storm_every_s 30
+call :check_exit "DoorSim (storms)" %ERRORLEVEL% || exit /b 1
+"%SIM_EXE%" --cycles 1000 --fault_every 5 --lines 2 --cut_every_s 7 --line_skew_us 1000 --line_jitter_us 3000
+call :check_exit "DoorSim (redundant lines)" %ERRORLEVEL% || exit /b 1
+
+if "%CHANNEL%"=="" (
+  echo Allocation check passed. Pass a channel to also run DoorNode and HmiApp on hardware.
+  exit /b 0
+)
+
+if not exist "%DOOR_EXE%" (
+  echo DoorNode executable not found: %DOOR_EXE%
+  exit /b 1
+)
+if not exist "%HMI_EXE%" (
+  echo HmiApp executable not found: %HMI_EXE%
+  exit /b 1
+)
+if exist "%RESULT_DIR%" rmdir /s /q "%RESULT_DIR%"
+mkdir "%RESULT_DIR%"
+
+REM 10 ms status period is 10x the default frame rate per door.
+echo Starting doors on %CHANNEL% for %DOOR_DURATION_S% s...
+for %%D in (1 2 3) do start "DoorNode-%%D" /min cmd /c call "%~f0" :door %%D
+ping -n 3 127.0.0.1 >nul
+
+echo Starting HMI for %DURATION_S% s, opening and closing every door each second...
+call "%~f0" :commands | "%HMI_EXE%" --channel %CHANNEL% --duration_s %DURATION_S% --shm_name none
+call :check_exit "HmiApp" %ERRORLEVEL% || exit /b 1
+
+echo Waiting for the doors to finish...
+set /a "WAIT_S=DOOR_DURATION_S + 30"
+:wait_doors
+if exist "%RESULT_DIR%\door1.rc" if exist "%RESULT_DIR%\door2.rc" if exist "%RESULT_DIR%\door3.rc" goto doors_done
+set /a "WAIT_S-=1"
+if %WAIT_S% LEQ 0 (
+  echo DoorNodes did not exit in time; see %RESULT_DIR%.
+  exit /b 1
+)
+ping -n 2 127.0.0.1 >nul
+goto wait_doors
+
+:doors_done
+REM call expands RC_VALUE again after set /p has read it.
+for %%I in (1 2 3) do (
+  set /p RC_VALUE=<"%RESULT_DIR%\door%%I.rc"
+  call :check_exit "DoorNode %%I" %%RC_VALUE%% || exit /b 1
+)
+echo Allocation check passed.
+endlocal
+exit /b 0
+
+REM check_exit <name> <exit code>
+:check_exit
+if "%~2"=="0" exit /b 0
+if "%~2"=="3" (
+  echo %~1 allocated after startup.
+) else (
+  echo %~1 failed with exit code %~2.
+)
+if exist "%RESULT_DIR%" echo Logs: %RESULT_DIR%
+exit /b 1
+
+REM One DoorNode, run in its own window; records its exit code for the parent.
+:door_process
+"%DOOR_EXE%" --id %2 --channel %CHANNEL% --period_ms 10 --move_ms 200 --duration_s %DOOR_DURATION_S% > "%RESULT_DIR%\door%2.log" 2>&1
+> "%RESULT_DIR%\door%2.rc" echo %ERRORLEVEL%
+exit /b 0
+
+REM HmiApp menu selections on stdout: 1/4/7 open doors 1-3, 2/5/8 close them.
+:command_feed
+set /a "CYCLES=DURATION_S / 2"
+for /l %%N in (1,1,%CYCLES%) do (
+  echo 1
+  echo 4
+  echo 7
+  ping -n 2 127.0.0.1 >nul
+  echo 2
+  echo 5
+  echo 8
+  ping -n 2 127.0.0.1 >nul
+)
+exit /b 0
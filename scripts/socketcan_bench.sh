@@ -0,0 +1,50 @@
+#!/bin/sh
+# Compare one-frame-per-call and batched SocketCAN receive on vcan0.
+# Requires can-utils (cangen) and an HmiApp built for Linux (see docs/SocketCAN_Linux.md).
+set -e
+
+HMI_EXE=${HMI_EXE:-./HmiApp}
+IFACE=${IFACE:-vcan0}
+DURATION_S=${DURATION_S:-10}
+
+if [ ! -x "$HMI_EXE" ]; then
+  echo "HmiApp executable not found: $HMI_EXE"
+  exit 1
+fi
+
+if ! ip link show "$IFACE" >/dev/null 2>&1; then
+  sudo modprobe vcan
+  sudo ip link add dev "$IFACE" type vcan
+  sudo ip link set up "$IFACE"
+fi
+
+table=""
+for batch in 1 32; do
+  echo "== --rx_batch $batch =="
+  # Constant payload (door 1 CLOSED) so HmiApp logs no state changes during the flood.
+  cangen "$IFACE" -I 101 -L 8 -D 0000000100000000 -g 0 &
+  gen_pid=$!
+  # stdin is /dev/null: with --duration_s, HmiApp takes the EOF as "no more input" and keeps
+  # running until the deadline. The console table is discarded; only the shutdown stats are kept.
+  output=$("$HMI_EXE" --channel "$IFACE" --duration_s "$DURATION_S" --rx_batch "$batch" --shm_name none \
+    </dev/null 2>&1 || true)
+  kill "$gen_pid"
+  wait "$gen_pid" 2>/dev/null || true
+  stats=$(printf '%s\n' "$output" | grep "SocketCAN rx:" || true)
+  if [ -z "$stats" ]; then
+    echo "No rx statistics from HmiApp; its output ends with:"
+    printf '%s\n' "$output" | tail -n 20
+    exit 1
+  fi
+  printf '%s\n' "$stats"
+  row=$(printf '%s\n' "$stats" | sed -n \
+    's/.* rx: \([0-9]*\) frames \/ \([0-9]*\) calls (\([0-9.]*\) frames\/call), \([0-9.]*\) us rx CPU\/frame, \([0-9]*\) dropped.*/| \1 | \2 | \3 | \4 | \5 |/p')
+  table="$table| $batch $row
+"
+done
+
+# Rows for the results table in docs/SocketCAN_Linux.md.
+echo
+echo "| --rx_batch | Frames | Calls | Frames/call | us rx CPU/frame | Dropped |"
+echo "|---|---|---|---|---|---|"
+printf '%s' "$table"